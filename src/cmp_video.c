@@ -23,16 +23,34 @@
 #define _GNU_SOURCE 1
 #include "sysdeps.h"
 #include <getopt.h>
+#include <inttypes.h>
 #include "mvt_image_file.h"
+#include "mvt_image_pool.h"
 #include "mvt_image_compare.h"
 #include "mvt_map.h"
+#include "mvt_memory.h"
+#include "mvt_numa.h"
 
 // Default image quality metric
 #define DEFAULT_METRIC MVT_IMAGE_QUALITY_METRIC_PSNR
 
+// Default amplification factor for differences
+#define DEFAULT_DIFF_SCALE 8
+
+// Default number of frames to look ahead for temporal alignment
+#define DEFAULT_ALIGN_WINDOW 8
+
+// Fingerprint distance penalty for each skipped frame, i.e. an average
+// difference of 4 per fingerprint sample
+#define ALIGN_SKIP_PENALTY \
+    (4 * MVT_IMAGE_FINGERPRINT_SIZE * MVT_IMAGE_FINGERPRINT_SIZE)
+
 static const MvtMap image_qm_map[] = {
     { "psnr",   MVT_IMAGE_QUALITY_METRIC_PSNR   },
     { "y_psnr", MVT_IMAGE_QUALITY_METRIC_Y_PSNR },
+    { "exact",  MVT_IMAGE_QUALITY_METRIC_EXACT  },
+    { "max_diff", MVT_IMAGE_QUALITY_METRIC_MAX_DIFF },
+    { "mismatch", MVT_IMAGE_QUALITY_METRIC_MISMATCH },
     { NULL, }
 };
 
@@ -44,10 +62,49 @@ typedef struct {
 } VideoStream;
 
 typedef struct {
+    VideoStream video;
+    double qvalue_sum;
+    uint64_t num_samples;
+    uint64_t num_mismatches;
+    uint32_t max_diff;
+    MvtImage *depth_image;      // Reference frame at the source bit depth
+} RefStream;
+
+typedef struct {
+    MvtImage *image;
+    MvtImageFingerprint fingerprint;
+    uint32_t index;
+} AlignFrame;
+
+typedef struct {
+    AlignFrame *frames;
+    uint32_t max_frames;
+    uint32_t num_frames;
+    uint32_t start;
+    uint32_t next_index;
+    bool eos;
+} AlignQueue;
+
+typedef struct {
+    MvtImagePool *image_pool;
     MvtImageQualityMetric metric;
     VideoStream src_video;
-    VideoStream ref_video;
+    RefStream *refs;
+    uint32_t num_refs;
+    VideoStream diff_video;
+    VideoStream map_video;
+    uint32_t diff_scale;
+    uint32_t align_window;
+    AlignQueue src_queue;
+    AlignQueue ref_queue;
+    uint32_t start_frame;
+    uint32_t num_frames;
+    uint32_t frame_step;
+    uint32_t tolerance;
+    bool check_tolerance;
+    MvtImageDiffStats stats[4];
     bool calc_average;
+    const char *numa_policy;
 } App;
 
 static App g_app;
@@ -63,18 +120,37 @@ get_basename(const char *filename)
 static void
 print_help(const char *prog)
 {
-    printf("Usage: %s [<option>]* -r <ref_video> <video>\n",
+    printf("Usage: %s [<option>]* -r <ref_video> [-r <ref_video>]* <video>\n",
            get_basename(prog));
     printf("\n");
     printf("Options:\n");
     printf("  %-28s  display this help and exit\n",
            "-h, --help");
-    printf("  %-28s  define the reference video file in Y4M format\n",
+    printf("  %-28s  add a reference video file in Y4M format\n",
            "-r, --reference");
     printf("  %-28s  define the image quality metric to use (default: %s)\n",
            "-m, --metric", mvt_map_lookup_value(image_qm_map, DEFAULT_METRIC));
     printf("  %-28s  compute the average over the file (default: false)\n",
            "-a, --average");
+    printf("  %-28s  write the absolute differences to the first reference "
+           "to a Y4M file\n", "    --diff-output=PATH");
+    printf("  %-28s  amplification factor for differences (default: %u)\n",
+           "    --diff-scale=N", DEFAULT_DIFF_SCALE);
+    printf("  %-28s  write the %ux%u blocks error map to a Y4M file\n",
+           "    --diff-map=PATH", MVT_IMAGE_COMPARE_BLOCK_SIZE,
+           MVT_IMAGE_COMPARE_BLOCK_SIZE);
+    printf("  %-28s  align frames within a window (default: %u frames)\n",
+           "    --align[=WINDOW]", DEFAULT_ALIGN_WINDOW);
+    printf("  %-28s  fail if any sample differs by more than T\n",
+           "    --tolerance=T");
+    printf("  %-28s  index of the first frame to compare (default: 0)\n",
+           "    --start=N");
+    printf("  %-28s  number of frames to compare (default: all)\n",
+           "    --count=N");
+    printf("  %-28s  compare every N-th frame only (default: 1)\n",
+           "    --step=N");
+    printf("  %-28s  run on node:N or cpus:LIST, with memory nearby\n",
+           "    --numa=POLICY");
 
     exit(EXIT_FAILURE);
 }
@@ -82,11 +158,32 @@ print_help(const char *prog)
 static bool
 app_init_args(App *app, int argc, char *argv[])
 {
+    enum {
+        OPT_DIFF_OUTPUT = 1000,
+        OPT_DIFF_SCALE,
+        OPT_DIFF_MAP,
+        OPT_ALIGN,
+        OPT_TOLERANCE,
+        OPT_START,
+        OPT_COUNT,
+        OPT_STEP,
+        OPT_NUMA,
+    };
+
     static const struct option long_options[] = {
         { "help",       no_argument,        NULL, 'h'                   },
         { "reference",  required_argument,  NULL, 'r'                   },
         { "metric",     required_argument,  NULL, 'm'                   },
         { "average",    no_argument,        NULL, 'a'                   },
+        { "diff-output", required_argument, NULL, OPT_DIFF_OUTPUT       },
+        { "diff-scale", required_argument,  NULL, OPT_DIFF_SCALE        },
+        { "diff-map",   required_argument,  NULL, OPT_DIFF_MAP          },
+        { "align",      optional_argument,  NULL, OPT_ALIGN             },
+        { "tolerance",  required_argument,  NULL, OPT_TOLERANCE         },
+        { "start",      required_argument,  NULL, OPT_START             },
+        { "count",      required_argument,  NULL, OPT_COUNT             },
+        { "step",       required_argument,  NULL, OPT_STEP              },
+        { "numa",       required_argument,  NULL, OPT_NUMA              },
         { NULL, }
     };
 
@@ -107,12 +204,19 @@ app_init_args(App *app, int argc, char *argv[])
             if (!app->src_video.filename)
                 goto error_alloc_memory;
             break;
-        case 'r':
-            free(app->ref_video.filename);
-            app->ref_video.filename = strdup(optarg);
-            if (!app->ref_video.filename)
+        case 'r': {
+            RefStream * const refs = realloc(app->refs,
+                (app->num_refs + 1) * sizeof(*refs));
+
+            if (!refs)
+                goto error_alloc_memory;
+            app->refs = refs;
+            memset(&refs[app->num_refs], 0, sizeof(*refs));
+            refs[app->num_refs].video.filename = strdup(optarg);
+            if (!refs[app->num_refs++].video.filename)
                 goto error_alloc_memory;
             break;
+        }
         case 'm': {
             const MvtImageQualityMetric metric =
                 mvt_map_lookup(image_qm_map, optarg);
@@ -125,6 +229,45 @@ app_init_args(App *app, int argc, char *argv[])
         case 'a':
             app->calc_average = true;
             break;
+        case OPT_DIFF_OUTPUT:
+            free(app->diff_video.filename);
+            app->diff_video.filename = strdup(optarg);
+            if (!app->diff_video.filename)
+                goto error_alloc_memory;
+            break;
+        case OPT_DIFF_SCALE:
+            app->diff_scale = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_DIFF_MAP:
+            free(app->map_video.filename);
+            app->map_video.filename = strdup(optarg);
+            if (!app->map_video.filename)
+                goto error_alloc_memory;
+            break;
+        case OPT_ALIGN:
+            app->align_window = optarg ? strtoul(optarg, NULL, 0) :
+                DEFAULT_ALIGN_WINDOW;
+            if (!app->align_window)
+                goto error_parse_align_window;
+            break;
+        case OPT_TOLERANCE:
+            app->tolerance = strtoul(optarg, NULL, 0);
+            app->check_tolerance = true;
+            break;
+        case OPT_START:
+            app->start_frame = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_COUNT:
+            app->num_frames = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_STEP:
+            app->frame_step = strtoul(optarg, NULL, 0);
+            if (!app->frame_step)
+                goto error_parse_frame_step;
+            break;
+        case OPT_NUMA:
+            app->numa_policy = optarg;
+            break;
         default:
             break;
         }
@@ -138,25 +281,32 @@ error_alloc_memory:
 error_parse_metric:
     mvt_error("failed to parse image quality metric ('%s')", optarg);
     return false;
+error_parse_align_window:
+    mvt_error("failed to parse alignment window ('%s')", optarg);
+    return false;
+error_parse_frame_step:
+    mvt_error("failed to parse frame step ('%s')", optarg);
+    return false;
 }
 
 static bool
 app_init_video(App *app, VideoStream *vsp, const char *name)
 {
-    MvtImageInfo * const info = &vsp->image_info;
-
     if (!vsp->filename)
         goto error_no_filename;
 
-    vsp->file = mvt_image_file_open(vsp->filename, MVT_IMAGE_FILE_MODE_READ);
+    // Frames are read as views into the file mapping, with no copy
+    vsp->file = mvt_image_file_open(vsp->filename,
+        MVT_IMAGE_FILE_MODE_READ|MVT_IMAGE_FILE_MODE_MMAP);
     if (!vsp->file)
         goto error_open_file;
     if (!mvt_image_file_read_headers(vsp->file, &vsp->image_info))
         goto error_read_headers;
 
-    vsp->image = mvt_image_new(info->format, info->width, info->height);
-    if (!vsp->image)
-        goto error_alloc_image;
+    // Frames are skipped by seeking, e.g. pipes can only be read in order
+    if ((app->start_frame > 0 || app->frame_step != 1) &&
+        !mvt_image_file_is_seekable(vsp->file))
+        goto error_not_seekable;
     return true;
 
     /* ERRORS */
@@ -169,23 +319,193 @@ error_open_file:
 error_read_headers:
     mvt_error("failed to read video file headers");
     return false;
+error_not_seekable:
+    mvt_error("cannot skip frames in non-seekable video file ('%s')",
+        vsp->filename);
+    return false;
+}
+
+// Determines the format of the blocks error map, i.e. 16-bit planar YUV
+static VideoFormat
+get_block_map_format(VideoFormat format)
+{
+    switch (video_format_get_chroma_type(format)) {
+    case VA_RT_FORMAT_YUV420:
+        return VIDEO_FORMAT_I420P16;
+    case VA_RT_FORMAT_YUV422:
+        return VIDEO_FORMAT_I422P16;
+    case VA_RT_FORMAT_YUV444:
+        return VIDEO_FORMAT_I444P16;
+    }
+    return VIDEO_FORMAT_UNKNOWN;
+}
+
+static bool
+app_init_output(App *app, VideoStream *vsp, VideoFormat format,
+    uint32_t width, uint32_t height)
+{
+    MvtImageInfo * const info = &vsp->image_info;
+
+    if (!vsp->filename)
+        return true;
+    if (!video_format_is_yuv(format))
+        goto error_unsupported_format;
+
+    vsp->file = mvt_image_file_open(vsp->filename, MVT_IMAGE_FILE_MODE_WRITE);
+    if (!vsp->file)
+        goto error_open_file;
+
+    *info = app->src_video.image_info;
+    info->format = format;
+    info->width = width;
+    info->height = height;
+    if (!mvt_image_file_write_headers(vsp->file, info))
+        goto error_write_headers;
+
+    vsp->image = mvt_image_pool_acquire(app->image_pool, format, width,
+        height);
+    if (!vsp->image)
+        goto error_alloc_image;
+
+    // Unused components are left untouched, e.g. chroma for Y-PSNR
+    memset(vsp->image->data, 0, vsp->image->data_size);
+    return true;
+
+    /* ERRORS */
+error_unsupported_format:
+    mvt_error("unsupported output format for `%s'", vsp->filename);
+    return false;
+error_open_file:
+    mvt_error("failed to open output file ('%s')", vsp->filename);
+    return false;
+error_write_headers:
+    mvt_error("failed to write output file headers");
+    return false;
 error_alloc_image:
-    mvt_error("failed to allocate video frame");
+    mvt_error("failed to allocate output frame");
+    return false;
+}
+
+static bool
+app_init_queue(App *app, AlignQueue *queue)
+{
+    queue->max_frames = app->align_window + 1;
+    queue->next_index = app->start_frame;
+    queue->frames = calloc(queue->max_frames, sizeof(*queue->frames));
+    if (!queue->frames)
+        goto error_alloc_memory;
+    return true;
+
+    /* ERRORS */
+error_alloc_memory:
+    mvt_error("failed to allocate memory");
+    return false;
+}
+
+/* Allocates a conversion image if the reference has a different bit
+   depth than the source, e.g. 8-bit and 10-bit outputs of a decoder. Only
+   the bit depth is converted, so the chroma formats have to match */
+static bool
+app_init_ref_depth(App *app, RefStream *ref, const MvtImageInfo *src_info)
+{
+    const MvtImageInfo * const info = &ref->video.image_info;
+    const VideoFormatInfo *src_vip, *vip;
+
+    src_vip = video_format_get_info(src_info->format);
+    vip = video_format_get_info(info->format);
+    if (!src_vip || !vip ||
+        src_vip->components[0].bit_depth == vip->components[0].bit_depth)
+        return true;
+    if (video_format_get_chroma_type(src_info->format) !=
+        video_format_get_chroma_type(info->format))
+        goto error_chroma_type;
+
+    ref->depth_image = mvt_image_pool_acquire(app->image_pool,
+        src_info->format, info->width, info->height);
+    if (!ref->depth_image)
+        goto error_alloc_image;
+    return true;
+
+    /* ERRORS */
+error_chroma_type:
+    mvt_error("reference video has a different chroma format ('%s')",
+        ref->video.filename);
+    return false;
+error_alloc_image:
+    mvt_error("failed to allocate %u-bit image for %s",
+        src_vip->components[0].bit_depth, ref->video.filename);
     return false;
 }
 
 static bool
 app_init(App *app, int argc, char *argv[])
 {
+    const MvtImageInfo *info;
+    const uint32_t bs = MVT_IMAGE_COMPARE_BLOCK_SIZE;
+    uint32_t i;
+
     app->metric = DEFAULT_METRIC;
+    app->diff_scale = DEFAULT_DIFF_SCALE;
+    app->num_frames = UINT32_MAX;
+    app->frame_step = 1;
     if (!app_init_args(app, argc, argv))
         return false;
 
+    // Place frames and threads before any of them is allocated
+    if (app->numa_policy && !mvt_numa_apply_policy(app->numa_policy))
+        return false;
+
+    app->image_pool = mvt_image_pool_new(MVT_IMAGE_POOL_DEFAULT_MAX_SIZE);
+    if (!app->image_pool)
+        goto error_alloc_pool;
+
     if (!app_init_video(app, &app->src_video, "source"))
         return false;
-    if (!app_init_video(app, &app->ref_video, "reference"))
+    if (!app->num_refs)
+        goto error_no_reference;
+    for (i = 0; i < app->num_refs; i++) {
+        if (!app_init_video(app, &app->refs[i].video, "reference"))
+            return false;
+    }
+
+    info = &app->src_video.image_info;
+    for (i = 0; i < app->num_refs; i++) {
+        if (!app_init_ref_depth(app, &app->refs[i], info))
+            return false;
+    }
+    if (!app_init_output(app, &app->diff_video,
+            video_format_normalize(info->format), info->width, info->height))
+        return false;
+    if (!app_init_output(app, &app->map_video,
+            get_block_map_format(info->format),
+            (info->width + bs - 1) / bs, (info->height + bs - 1) / bs))
         return false;
+
+    if (app->align_window > 0) {
+        if (app->num_refs > 1)
+            goto error_align_multiple_refs;
+        if (app->num_frames != UINT32_MAX || app->frame_step != 1)
+            goto error_align_frame_range;
+        if (!app_init_queue(app, &app->src_queue))
+            return false;
+        if (!app_init_queue(app, &app->ref_queue))
+            return false;
+    }
     return true;
+
+    /* ERRORS */
+error_alloc_pool:
+    mvt_error("failed to allocate image pool");
+    return false;
+error_no_reference:
+    mvt_error("no reference video filename supplied");
+    return false;
+error_align_multiple_refs:
+    mvt_error("alignment mode only supports a single reference");
+    return false;
+error_align_frame_range:
+    mvt_error("alignment mode only supports a start frame");
+    return false;
 }
 
 static void
@@ -195,52 +515,430 @@ app_finalize_video(App *app, VideoStream *vsp)
         mvt_image_file_close(vsp->file);
         vsp->file = NULL;
     }
-    mvt_image_freep(&vsp->image);
+    mvt_image_pool_releasep(app->image_pool, &vsp->image);
     free(vsp->filename);
     vsp->filename = NULL;
 }
 
+static void
+app_finalize_queue(App *app, AlignQueue *queue)
+{
+    uint32_t i;
+
+    if (!queue->frames)
+        return;
+
+    for (i = 0; i < queue->max_frames; i++)
+        mvt_image_pool_releasep(app->image_pool, &queue->frames[i].image);
+    free(queue->frames);
+    queue->frames = NULL;
+}
+
 static void
 app_finalize(App *app)
 {
+    uint32_t i;
+
     if (!app)
         return;
 
+    app_finalize_queue(app, &app->src_queue);
+    app_finalize_queue(app, &app->ref_queue);
     app_finalize_video(app, &app->src_video);
-    app_finalize_video(app, &app->ref_video);
+    for (i = 0; i < app->num_refs; i++) {
+        app_finalize_video(app, &app->refs[i].video);
+        mvt_image_pool_releasep(app->image_pool, &app->refs[i].depth_image);
+    }
+    free(app->refs);
+    app->refs = NULL;
+    app->num_refs = 0;
+    app_finalize_video(app, &app->diff_video);
+    app_finalize_video(app, &app->map_video);
+    mvt_image_pool_freep(&app->image_pool);
+}
+
+// Prints the index of the compared frames, i.e. both in alignment mode
+static void
+app_print_frame_index(App *app, uint32_t src_n, uint32_t ref_n)
+{
+    if (app->align_window > 0)
+        printf("%7u %7u", src_n, ref_n);
+    else
+        printf("%7u", src_n);
 }
 
 static bool
-app_run(App *app)
+app_compare_exact(App *app, MvtImage *src_image, MvtImage *ref_image,
+    MvtImageCompareInfo *info, double *qvalue_ptr)
 {
-    VideoStream * const src = &app->src_video;
-    VideoStream * const ref = &app->ref_video;
-    double qvalue, qvalue_sum = 0.0;
-    uint32_t n = 0;
-
-    while (mvt_image_file_read_image(src->file, src->image)) {
-        if (!mvt_image_file_read_image(ref->file, ref->image))
-            goto error_read_ref_frame;
-        if (!mvt_image_compare(src->image, ref->image, app->metric, &qvalue))
+    static const char *yuv_names = "YUVA", *rgb_names = "RGBA";
+    const char *names;
+    MvtImageDiffReport report;
+    double psnr;
+
+    if (info && !mvt_image_compare_full(src_image, ref_image,
+            MVT_IMAGE_QUALITY_METRIC_PSNR, info, &psnr))
+        return false;
+    if (!mvt_image_compare_exact(src_image, ref_image, 0, &report))
+        return false;
+    *qvalue_ptr = report.num_diffs;
+    if (app->calc_average)
+        return true;
+
+    if (!report.num_diffs) {
+        printf(" 0");
+        return true;
+    }
+
+    names = video_format_is_yuv(src_image->format) ? yuv_names : rgb_names;
+    printf(" %" PRIu64 " first=%c:%u,%u bbox=%ux%u+%d+%d",
+        report.num_diffs, names[report.first_component], report.first_x,
+        report.first_y, report.bbox.width, report.bbox.height,
+        report.bbox.x, report.bbox.y);
+    return true;
+}
+
+// Accumulates the statistics of absolute differences of a pair of frames
+static void
+app_update_stats(App *app, RefStream *ref, const MvtImageDiffStats *stats)
+{
+    uint32_t n;
+
+    for (n = 0; n < 4; n++) {
+        ref->num_samples += stats[n].num_samples;
+        ref->num_mismatches += stats[n].num_mismatches;
+        ref->max_diff = MVT_MAX(ref->max_diff, stats[n].max_diff);
+    }
+}
+
+// Checks the differences are within tolerance over the whole run
+static bool
+app_check_tolerance(App *app)
+{
+    bool success = true;
+    uint32_t i;
+
+    if (!app->check_tolerance)
+        return true;
+
+    for (i = 0; i < app->num_refs; i++) {
+        RefStream * const ref = &app->refs[i];
+
+        if (!ref->num_mismatches)
+            continue;
+        mvt_warning("%s: %" PRIu64 " samples (%.4f%%) exceed tolerance %u, "
+            "max difference is %u", ref->video.filename, ref->num_mismatches,
+            100.0 * ref->num_mismatches / ref->num_samples, app->tolerance,
+            ref->max_diff);
+        success = false;
+    }
+    return success;
+}
+
+/* Compares a pair of frames, and prints the resulting column group. The
+   side outputs are written only for the first reference */
+static bool
+app_compare_frames(App *app, RefStream *ref, MvtImage *src_image,
+    MvtImage *ref_image, uint32_t n)
+{
+    const bool has_outputs = ref == &app->refs[0];
+    MvtImageCompareInfo info, *info_ptr = NULL;
+    double qvalue;
+
+    memset(&info, 0, sizeof(info));
+    if (has_outputs) {
+        info.diff_image = app->diff_video.image;
+        info.diff_scale = app->diff_scale;
+        info.block_map = app->map_video.image;
+    }
+    info.tolerance = app->tolerance;
+    if (app->check_tolerance)
+        info.stats = app->stats;
+    if (info.diff_image || info.block_map || info.stats)
+        info_ptr = &info;
+
+    // Compare at the source bit depth, if the reference has another one
+    if (ref->depth_image) {
+        if (!mvt_image_convert(ref->depth_image, ref_image))
+            goto error_convert_depth;
+        ref_image = ref->depth_image;
+    }
+
+    if (app->metric == MVT_IMAGE_QUALITY_METRIC_EXACT) {
+        if (!app_compare_exact(app, src_image, ref_image, info_ptr, &qvalue))
             goto error_calc_quality;
-        if (app->calc_average)
-            qvalue_sum += qvalue;
-        else
-            printf("%7u %.4f\n", n, qvalue);
-        n++;
     }
+    else {
+        if (!mvt_image_compare_full(src_image, ref_image, app->metric,
+                info_ptr, &qvalue))
+            goto error_calc_quality;
+        if (!app->calc_average)
+            printf(" %.4f", qvalue);
+    }
+    ref->qvalue_sum += qvalue;
 
-    if (app->calc_average)
-        printf("%.4f\n", qvalue_sum / n);
+    if (info.stats)
+        app_update_stats(app, ref, info.stats);
+
+    if (info.diff_image &&
+        !mvt_image_file_write_image(app->diff_video.file, info.diff_image))
+        goto error_write_output;
+    if (info.block_map &&
+        !mvt_image_file_write_image(app->map_video.file, info.block_map))
+        goto error_write_output;
     return true;
 
     /* ERRORS */
-error_read_ref_frame:
-    mvt_error("failed to read reference frame %u", n);
+error_convert_depth:
+    mvt_error("failed to convert reference frame %u to source bit depth", n);
     return false;
 error_calc_quality:
     mvt_error("failed to compute quality for frame %u", n);
     return false;
+error_write_output:
+    mvt_error("failed to write differences for frame %u", n);
+    return false;
+}
+
+// Prints the average quality for each reference
+static void
+app_print_average(App *app, uint32_t num_frames)
+{
+    uint32_t i;
+
+    for (i = 0; i < app->num_refs; i++)
+        printf("%s%.4f", i > 0 ? " " : "", num_frames > 0 ?
+            app->refs[i].qvalue_sum / num_frames : 0.0);
+    printf("\n");
+}
+
+// Reads the next frame from the video stream, replacing the previous one
+static bool
+app_read_frame(App *app, VideoStream *vsp, MvtImage **image_ptr)
+{
+    mvt_image_pool_releasep(app->image_pool, image_ptr);
+    *image_ptr = mvt_image_file_map_image(vsp->file, app->image_pool);
+    return *image_ptr != NULL;
+}
+
+/* Compares each source frame against all the references in turn, while
+   it is still hot in cache */
+static bool
+app_run_sequential(App *app)
+{
+    VideoStream * const src = &app->src_video;
+    uint32_t i, k, n = app->start_frame;
+
+    for (k = 0; k < app->num_frames; k++, n += app->frame_step) {
+        // Seek past the skipped frames, so that they are never read
+        if (k > 0 && app->frame_step > 1 &&
+            !mvt_image_file_seek(src->file, n))
+            break;
+        if (!app_read_frame(app, src, &src->image))
+            break;
+        if (!app->calc_average)
+            app_print_frame_index(app, n, n);
+        for (i = 0; i < app->num_refs; i++) {
+            RefStream * const ref = &app->refs[i];
+
+            if (k > 0 && app->frame_step > 1 &&
+                !mvt_image_file_seek(ref->video.file, n))
+                goto error_read_ref_frame;
+            if (!app_read_frame(app, &ref->video, &ref->video.image))
+                goto error_read_ref_frame;
+            if (!app_compare_frames(app, ref, src->image, ref->video.image,
+                    n))
+                return false;
+        }
+        if (!app->calc_average)
+            printf("\n");
+    }
+
+    if (app->calc_average)
+        app_print_average(app, k);
+    return true;
+
+    /* ERRORS */
+error_read_ref_frame:
+    if (!app->calc_average)
+        printf("\n");
+    mvt_error("failed to read reference frame %u from `%s'", n,
+        app->refs[i].video.filename);
+    return false;
+}
+
+// Seeks all video streams to the start frame
+static bool
+app_seek_start(App *app)
+{
+    uint32_t i;
+
+    if (!app->start_frame)
+        return true;
+
+    if (!mvt_image_file_seek(app->src_video.file, app->start_frame))
+        goto error_seek;
+    for (i = 0; i < app->num_refs; i++) {
+        if (!mvt_image_file_seek(app->refs[i].video.file, app->start_frame))
+            goto error_seek;
+    }
+    return true;
+
+    /* ERRORS */
+error_seek:
+    mvt_error("failed to seek to frame %u", app->start_frame);
+    return false;
+}
+
+// Returns the i-th frame from the queue
+static inline AlignFrame *
+align_queue_get(AlignQueue *queue, uint32_t i)
+{
+    return &queue->frames[(queue->start + i) % queue->max_frames];
+}
+
+// Removes the first frame from the queue
+static inline void
+align_queue_pop(AlignQueue *queue)
+{
+    queue->start = (queue->start + 1) % queue->max_frames;
+    queue->num_frames--;
+}
+
+// Fills the queue with frames from the video stream, until end-of-stream
+static bool
+app_fill_queue(App *app, AlignQueue *queue, VideoStream *vsp)
+{
+    AlignFrame *frame;
+
+    while (!queue->eos && queue->num_frames < queue->max_frames) {
+        frame = align_queue_get(queue, queue->num_frames);
+        if (!app_read_frame(app, vsp, &frame->image)) {
+            queue->eos = true;
+            break;
+        }
+        if (!mvt_image_get_fingerprint(frame->image, &frame->fingerprint))
+            goto error_fingerprint;
+        frame->index = queue->next_index++;
+        queue->num_frames++;
+    }
+    return true;
+
+    /* ERRORS */
+error_fingerprint:
+    mvt_error("failed to compute fingerprint for frame %u",
+        queue->next_index);
+    return false;
+}
+
+/* Determines the best match among the queued frames. Either source
+   frames were inserted (*src_skip_ptr > 0), or reference frames were
+   dropped (*ref_skip_ptr > 0), and each skipped frame is penalized so
+   that in-sync frames are preferred unless a better match exists */
+static void
+app_find_match(App *app, uint32_t *src_skip_ptr, uint32_t *ref_skip_ptr)
+{
+    AlignQueue * const src_queue = &app->src_queue;
+    AlignQueue * const ref_queue = &app->ref_queue;
+    const MvtImageFingerprint * const src_fp =
+        &align_queue_get(src_queue, 0)->fingerprint;
+    const MvtImageFingerprint * const ref_fp =
+        &align_queue_get(ref_queue, 0)->fingerprint;
+    uint32_t i, cost, best_cost, src_skip = 0, ref_skip = 0;
+
+    best_cost = mvt_image_fingerprint_distance(src_fp, ref_fp);
+    for (i = 1; i < src_queue->num_frames && best_cost > 0; i++) {
+        cost = i * ALIGN_SKIP_PENALTY + mvt_image_fingerprint_distance(
+            &align_queue_get(src_queue, i)->fingerprint, ref_fp);
+        if (cost < best_cost) {
+            best_cost = cost;
+            src_skip = i;
+        }
+    }
+    for (i = 1; i < ref_queue->num_frames && best_cost > 0; i++) {
+        cost = i * ALIGN_SKIP_PENALTY + mvt_image_fingerprint_distance(
+            src_fp, &align_queue_get(ref_queue, i)->fingerprint);
+        if (cost < best_cost) {
+            best_cost = cost;
+            src_skip = 0;
+            ref_skip = i;
+        }
+    }
+    *src_skip_ptr = src_skip;
+    *ref_skip_ptr = ref_skip;
+}
+
+static bool
+app_run_aligned(App *app)
+{
+    AlignQueue * const src_queue = &app->src_queue;
+    AlignQueue * const ref_queue = &app->ref_queue;
+    AlignFrame *src_frame, *ref_frame;
+    uint32_t num_matched = 0, num_inserted = 0, num_dropped = 0;
+    uint32_t src_skip, ref_skip;
+
+    for (;;) {
+        if (!app_fill_queue(app, src_queue, &app->src_video))
+            return false;
+        if (!app_fill_queue(app, ref_queue, &app->refs[0].video))
+            return false;
+
+        if (src_queue->num_frames > 0 && ref_queue->num_frames > 0)
+            app_find_match(app, &src_skip, &ref_skip);
+        else if (src_queue->num_frames > 0)
+            src_skip = src_queue->num_frames, ref_skip = 0;
+        else if (ref_queue->num_frames > 0)
+            src_skip = 0, ref_skip = ref_queue->num_frames;
+        else
+            break;
+
+        for (; src_skip > 0; src_skip--) {
+            if (!app->calc_average)
+                printf("%7u %7s inserted\n",
+                    align_queue_get(src_queue, 0)->index, "-");
+            align_queue_pop(src_queue);
+            num_inserted++;
+        }
+        for (; ref_skip > 0; ref_skip--) {
+            if (!app->calc_average)
+                printf("%7s %7u dropped\n", "-",
+                    align_queue_get(ref_queue, 0)->index);
+            align_queue_pop(ref_queue);
+            num_dropped++;
+        }
+        if (!src_queue->num_frames || !ref_queue->num_frames)
+            continue;
+
+        src_frame = align_queue_get(src_queue, 0);
+        ref_frame = align_queue_get(ref_queue, 0);
+        if (!app->calc_average)
+            app_print_frame_index(app, src_frame->index, ref_frame->index);
+        if (!app_compare_frames(app, &app->refs[0], src_frame->image,
+                ref_frame->image, src_frame->index))
+            return false;
+        if (!app->calc_average)
+            printf("\n");
+        align_queue_pop(src_queue);
+        align_queue_pop(ref_queue);
+        num_matched++;
+    }
+
+    if (app->calc_average)
+        app_print_average(app, num_matched);
+    if (num_inserted > 0 || num_dropped > 0)
+        mvt_warning("%u frames matched, %u inserted, %u dropped",
+            num_matched, num_inserted, num_dropped);
+    return true;
+}
+
+static bool
+app_run(App *app)
+{
+    if (!app_seek_start(app))
+        return false;
+    if (app->align_window > 0)
+        return app_run_aligned(app);
+    return app_run_sequential(app);
 }
 
 int
@@ -248,11 +946,17 @@ main(int argc, char *argv[])
 {
     App * const app = &g_app;
     bool success = false;
+    uint64_t num_allocs;
 
     if (!app_init(app, argc, argv))
         goto cleanup;
+    num_allocs = mem_get_num_allocs();
     if (!app_run(app))
         goto cleanup;
+    mvt_info("made %" PRIu64 " heap allocations while comparing frames",
+        mem_get_num_allocs() - num_allocs);
+    if (!app_check_tolerance(app))
+        goto cleanup;
     success = true;
 
 cleanup:
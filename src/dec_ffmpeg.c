@@ -41,7 +41,6 @@ typedef struct {
     MvtDecoderFFmpeg base;
     MvtDisplay *display;
     const HWAccelDecoder *hwaccel;
-    MvtImage *image;
 
     // VA-API resources
     struct vaapi_context va_context;
@@ -359,6 +358,9 @@ decoder_vaapi_init_context(Decoder *decoder)
     avctx->get_buffer = vaapi_get_buffer;
     avctx->reget_buffer = vaapi_reget_buffer;
     avctx->release_buffer = vaapi_release_buffer;
+#if FFMPEG_HAS_REFCOUNTED_FRAMES
+    avctx->refcounted_frames = 0; // surfaces are recycled by release_buffer()
+#endif
     return true;
 }
 
@@ -432,19 +434,8 @@ decoder_vaapi_handle_frame(Decoder *decoder, AVFrame *frame)
     if (!mvt_image_init_from_subimage(&dst_image, &src_image, &crop_rect))
         goto error_crop_image;
 
-    if (!decoder->image || (decoder->image->width != dst_image.width ||
-            decoder->image->height != dst_image.height)) {
-        mvt_image_freep(&decoder->image);
-        decoder->image = mvt_image_new(VIDEO_FORMAT_I420,
-            dst_image.width, dst_image.height);
-        if (!decoder->image)
-            goto error_download_image;
-    }
-    if (!mvt_image_convert_full(decoder->image, &dst_image,
-            MVT_IMAGE_FLAG_FROM_USWC))
-        goto error_download_image;
-
-    success = mvt_decoder_handle_image(MVT_DECODER(decoder), decoder->image, 0);
+    success = mvt_decoder_handle_image(MVT_DECODER(decoder), &dst_image,
+        MVT_IMAGE_FLAG_FROM_USWC);
     mvt_image_clear(&dst_image);
     va_unmap_image(vactx->display, &va_image, &src_image);
     vaDestroyImage(vactx->display, va_image.image_id);
@@ -464,12 +455,6 @@ error_crop_image:
     va_unmap_image(vactx->display, &va_image, &src_image);
     vaDestroyImage(vactx->display, va_image.image_id);
     return false;
-error_download_image:
-    mvt_error("failed to download VA surface 0x%08x to I420 image", va_surface);
-    mvt_image_clear(&dst_image);
-    va_unmap_image(vactx->display, &va_image, &src_image);
-    vaDestroyImage(vactx->display, va_image.image_id);
-    return false;
 }
 
 static const HWAccelDecoder hwaccel_vaapi = {
@@ -539,7 +524,6 @@ decoder_finalize(Decoder *decoder)
     if (hwaccel && hwaccel->finalize)
         hwaccel->finalize(MVT_DECODER(decoder));
     mvt_display_freep(&decoder->display);
-    mvt_image_freep(&decoder->image);
 }
 
 static bool
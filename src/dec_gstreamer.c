@@ -300,7 +300,6 @@ typedef struct {
 #if GST_CHECK_VERSION(1,1,0)
     GstContext         *context;
 #endif
-    MvtImage           *image;
 
     /** @name Video post-processing options */
     /*@{*/
@@ -384,7 +383,6 @@ app_finalize(App *app)
         g_source_remove(app->bus_watch_id);
     if (app->loop)
         g_main_loop_unref(app->loop);
-    mvt_image_freep(&app->image);
     g_free(app->vparse_name);
     gst_caps_replace(&app->vparse_capsfilter, NULL);
     gst_object_replace((GstObject **)&app->vparse, NULL);
@@ -477,14 +475,24 @@ error_no_caps:
     return FALSE;
 }
 
+// Unmaps the video frame wrapped by an image, thus releasing the buffer
+static void
+release_video_frame(void *user_data)
+{
+    GstVideoFrame * const frame = user_data;
+
+    gst_video_frame_unmap(frame);
+    g_slice_free(GstVideoFrame, frame);
+}
+
 // Handle SW surfaces
 static gboolean
 app_handle_sw_surface(App *app, GstBuffer *buffer,
     const VARectangle *crop_rect)
 {
-    GstVideoFrame frame;
+    GstVideoFrame *frame;
     VideoFormat format;
-    MvtImage src_image, dst_image;
+    MvtImage src_image, dst_image, *image;
     VAImage va_image;
     const VAImageFormat *va_format;
     uint32_t i;
@@ -508,19 +516,26 @@ app_handle_sw_surface(App *app, GstBuffer *buffer,
     if (!mvt_image_init_from_va_image(&src_image, &va_image))
         goto error_unsupported_image;
 
-    if (!gst_video_frame_map(&frame, &app->vinfo, buffer, GST_MAP_READ))
+    /* The mapped frame holds a reference to the buffer, until the image
+       is released. So, it can be handed over to other threads */
+    frame = g_slice_new(GstVideoFrame);
+    if (!gst_video_frame_map(frame, &app->vinfo, buffer, GST_MAP_READ))
         goto error_map_buffer;
 
     for (i = 0; i < src_image.num_planes; i++)
-        src_image.pixels[i] = frame.data[i];
+        src_image.pixels[i] = frame->data[i];
 
     if (!mvt_image_init_from_subimage(&dst_image, &src_image, crop_rect))
         goto error_crop_image;
 
-    success = mvt_decoder_handle_image(&app->decoder, &dst_image, 0);
+    image = mvt_image_new_wrapped(&dst_image, release_video_frame, frame);
     mvt_image_clear(&dst_image);
     mvt_image_clear(&src_image);
-    gst_video_frame_unmap(&frame);
+    if (!image)
+        goto error_wrap_image;
+
+    success = mvt_decoder_handle_image(&app->decoder, image, 0);
+    mvt_image_unref(image);
     return success;
 
     /* ERRORS */
@@ -534,11 +549,16 @@ error_unsupported_image:
 error_map_buffer:
     app_error(app, "failed to map buffer %p", buffer);
     mvt_image_clear(&src_image);
+    g_slice_free(GstVideoFrame, frame);
     return FALSE;
 error_crop_image:
     app_error(app, "failed to extract cropped image from buffer %p", buffer);
     mvt_image_clear(&src_image);
-    gst_video_frame_unmap(&frame);
+    release_video_frame(frame);
+    return FALSE;
+error_wrap_image:
+    app_error(app, "failed to wrap image from buffer %p", buffer);
+    release_video_frame(frame);
     return FALSE;
 }
 
@@ -581,19 +601,8 @@ app_handle_hw_surface_vaapi(App *app, GstBuffer *buffer,
     if (!mvt_image_init_from_subimage(&dst_image, &src_image, crop_rect))
         goto error_crop_image;
 
-    if (!app->image || (app->image->width != dst_image.width ||
-            app->image->height != dst_image.height)) {
-        mvt_image_freep(&app->image);
-        app->image = mvt_image_new(video_format_normalize(dst_image.format),
-            dst_image.width, dst_image.height);
-        if (!app->image)
-            goto error_convert_image;
-    }
-    if (!mvt_image_convert_full(app->image, &dst_image,
-            MVT_IMAGE_FLAG_FROM_USWC))
-        goto error_convert_image;
-
-    success = mvt_decoder_handle_image(&app->decoder, app->image, 0);
+    success = mvt_decoder_handle_image(&app->decoder, &dst_image,
+        MVT_IMAGE_FLAG_FROM_USWC);
     mvt_image_clear(&dst_image);
     va_unmap_image(va_display, &va_image, &src_image);
     gst_vaapi_object_unref(image);
@@ -623,13 +632,6 @@ error_crop_image:
     gst_vaapi_object_replace(&image, NULL);
     gst_buffer_unmap(buffer, &map_info);
     return FALSE;
-error_convert_image:
-    app_error(app, "failed to convert VA image to native image");
-    mvt_image_clear(&dst_image);
-    va_unmap_image(va_display, &va_image, &src_image);
-    gst_vaapi_object_replace(&image, NULL);
-    gst_buffer_unmap(buffer, &map_info);
-    return FALSE;
 }
 
 static gboolean
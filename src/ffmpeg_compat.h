@@ -92,6 +92,10 @@ enum AVPixelFormat {
 #define FFMPEG_HAS_HEVC_DECODER \
     (LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(55,24,101))
 
+/* Checks whether library supports reference counted frames */
+#define FFMPEG_HAS_REFCOUNTED_FRAMES \
+    (LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(55,0,100))
+
 /* Codec ids */
 #if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(54,25,0)
 enum AVCodecID {
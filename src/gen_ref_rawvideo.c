@@ -37,17 +37,12 @@ decoder_init(Decoder *decoder)
     const MvtDecoderOptions * const options = &decoder->base.options;
 
     decoder->input_file = mvt_image_file_open(options->filename,
-        MVT_IMAGE_FILE_MODE_READ);
+        MVT_IMAGE_FILE_MODE_READ|MVT_IMAGE_FILE_MODE_MMAP);
     if (!decoder->input_file)
         return false;
     if (!mvt_image_file_read_headers(decoder->input_file, &decoder->input_info))
         return false;
 
-    decoder->image = mvt_image_new(decoder->input_info.format,
-        decoder->input_info.width, decoder->input_info.height);
-    if (!decoder->image)
-        return false;
-
     decoder->base.output_info = decoder->input_info;
     return true;
 }
@@ -59,13 +54,19 @@ decoder_finalize(Decoder *decoder)
         mvt_image_file_close(decoder->input_file);
         decoder->input_file = NULL;
     }
-    mvt_image_freep(&decoder->image);
+    mvt_image_pool_releasep(decoder->base.image_pool, &decoder->image);
 }
 
 static bool
 decoder_run(Decoder *decoder)
 {
-    while (mvt_image_file_read_image(decoder->input_file, decoder->image)) {
+    MvtImagePool * const pool = decoder->base.image_pool;
+
+    for (;;) {
+        mvt_image_pool_releasep(pool, &decoder->image);
+        decoder->image = mvt_image_file_map_image(decoder->input_file, pool);
+        if (!decoder->image)
+            break;
         if (!mvt_decoder_handle_image(&decoder->base, decoder->image, 0))
             return false;
     }
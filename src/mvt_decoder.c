@@ -23,8 +23,12 @@
 #define _GNU_SOURCE 1
 #include "sysdeps.h"
 #include <getopt.h>
+#include <inttypes.h>
 #include "mvt_decoder.h"
 #include "mvt_map.h"
+#include "mvt_memory.h"
+#include "mvt_numa.h"
+#include "mvt_string.h"
 
 // Default hash function
 #define DEFAULT_HASH MVT_HASH_TYPE_ADLER32
@@ -32,6 +36,12 @@
 // Default hardware acceleration mode
 #define DEFAULT_HWACCEL MVT_HWACCEL_NONE
 
+// Default number of decoded frames queued for output
+#define DEFAULT_OUTPUT_QUEUE_DEPTH 4
+
+// Maximum number of decoded frames queued for output
+#define MAX_OUTPUT_QUEUE_DEPTH 64
+
 static const MvtMap hwaccel_map[] = {
     { "none",   MVT_HWACCEL_NONE    },
     { "vaapi",  MVT_HWACCEL_VAAPI   },
@@ -59,6 +69,7 @@ mvt_decoder_options_init(MvtDecoderOptions *options)
     memset(options, 0, sizeof(*options));
     options->hash_type = DEFAULT_HASH;
     options->hwaccel = DEFAULT_HWACCEL;
+    options->output_queue_depth = DEFAULT_OUTPUT_QUEUE_DEPTH;
 }
 
 // Clears the decoder options
@@ -69,6 +80,7 @@ mvt_decoder_options_clear(MvtDecoderOptions *options)
     free(options->config_filename);
     free(options->report_filename);
     free(options->output_filename);
+    free(options->numa_policy);
     memset(options, 0, sizeof(*options));
 }
 
@@ -104,8 +116,13 @@ print_help(const char *prog)
            "    --gen-config[=PATH]");
     printf("  %-28s  define the output filename (default: <video>.raw)\n",
            "    --gen-output[=PATH]");
+    printf("  %-28s  define the output queue depth, 0 for synchronous "
+           "writes (default: %u)\n",
+           "    --output-queue=DEPTH", DEFAULT_OUTPUT_QUEUE_DEPTH);
     printf("  %-28s  enable benchmark mode (decode only)\n",
            "    --benchmark");
+    printf("  %-28s  run on node:N or cpus:LIST, with memory nearby\n",
+           "    --numa=POLICY");
 
     exit(EXIT_FAILURE);
 }
@@ -118,6 +135,7 @@ mvt_decoder_free(MvtDecoder *decoder)
     if (!decoder)
         return;
 
+    mvt_image_writer_free(decoder->output_writer);
     if (klass->finalize)
         klass->finalize(decoder);
     if (decoder->report)
@@ -126,6 +144,8 @@ mvt_decoder_free(MvtDecoder *decoder)
         mvt_hash_free(decoder->hash);
     if (decoder->output_file)
         mvt_image_file_close(decoder->output_file);
+    mvt_image_pool_releasep(decoder->image_pool, &decoder->download_image);
+    mvt_image_pool_freep(&decoder->image_pool);
     mvt_decoder_options_clear(&decoder->options);
     free(decoder);
 }
@@ -145,7 +165,15 @@ mvt_decoder_new(void)
     decoder->profile = -1;
     mvt_decoder_options_init(&decoder->options);
     mvt_image_info_init_defaults(&decoder->output_info);
+
+    decoder->image_pool = mvt_image_pool_new(MVT_IMAGE_POOL_DEFAULT_MAX_SIZE);
+    if (!decoder->image_pool)
+        goto error;
     return decoder;
+
+error:
+    mvt_decoder_free(decoder);
+    return NULL;
 }
 
 static bool
@@ -160,6 +188,8 @@ mvt_decoder_init_options(MvtDecoder *decoder, int argc, char *argv[])
         OPT_GEN_CONFIG,
         OPT_GEN_OUTPUT,
         OPT_BENCHMARK,
+        OPT_NUMA,
+        OPT_OUTPUT_QUEUE,
     };
 
     static const struct option long_options[] = {
@@ -172,6 +202,8 @@ mvt_decoder_init_options(MvtDecoder *decoder, int argc, char *argv[])
         { "gen-config", optional_argument,  NULL, OPT_GEN_CONFIG        },
         { "gen-output", optional_argument,  NULL, OPT_GEN_OUTPUT        },
         { "benchmark",  no_argument,        NULL, OPT_BENCHMARK         },
+        { "numa",       required_argument,  NULL, OPT_NUMA              },
+        { "output-queue", required_argument, NULL, OPT_OUTPUT_QUEUE     },
         { NULL, }
     };
 
@@ -238,6 +270,17 @@ mvt_decoder_init_options(MvtDecoder *decoder, int argc, char *argv[])
         case OPT_BENCHMARK:
             options->benchmark = true;
             break;
+        case OPT_NUMA:
+            free(options->numa_policy);
+            options->numa_policy = strdup(optarg);
+            if (!options->numa_policy)
+                goto error_alloc_memory;
+            break;
+        case OPT_OUTPUT_QUEUE:
+            if (!str_parse_uint(optarg, &options->output_queue_depth, 0) ||
+                options->output_queue_depth > MAX_OUTPUT_QUEUE_DEPTH)
+                goto error_parse_output_queue;
+            break;
         default:
             break;
         }
@@ -264,6 +307,9 @@ error_alloc_memory:
 error_invalid_hash:
     mvt_error("invalid hash name ('%s')", optarg);
     return false;
+error_parse_output_queue:
+    mvt_error("failed to parse output queue depth ('%s')", optarg);
+    return false;
 }
 
 static bool
@@ -277,6 +323,10 @@ mvt_decoder_init(MvtDecoder *decoder, int argc, char *argv[])
     if (!options->filename)
         goto error_no_filename;
 
+    // Pin threads before any of them is created, e.g. by the decoder
+    if (options->numa_policy && !mvt_numa_apply_policy(options->numa_policy))
+        return false;
+
     if (!is_dev_null(options->report_filename)) {
         decoder->report = mvt_report_new(options->report_filename);
         if (!decoder->report)
@@ -292,6 +342,13 @@ mvt_decoder_init(MvtDecoder *decoder, int argc, char *argv[])
             MVT_IMAGE_FILE_MODE_WRITE);
         if (!decoder->output_file)
             goto error_open_output_file;
+
+        if (options->output_queue_depth > 0) {
+            decoder->output_writer = mvt_image_writer_new(decoder->output_file,
+                options->output_queue_depth);
+            if (!decoder->output_writer)
+                goto error_create_output_writer;
+        }
     }
     return !klass->init || klass->init(decoder);
 
@@ -309,14 +366,54 @@ error_open_output_file:
     mvt_error("failed to open raw decoded output file `%s'",
         options->output_filename);
     return false;
+error_create_output_writer:
+    mvt_error("failed to create writer for raw decoded output file `%s'",
+        options->output_filename);
+    return false;
 }
 
 static bool
 mvt_decoder_run(MvtDecoder *decoder)
 {
     const MvtDecoderClass * const klass = mvt_decoder_class();
+    bool success;
 
-    return !klass->run || klass->run(decoder);
+    success = !klass->run || klass->run(decoder);
+    if (decoder->output_writer &&
+        !mvt_image_writer_finish(decoder->output_writer))
+        success = false;
+    return success;
+}
+
+// Downloads the supplied image from USWC memory, in its normalized format
+static MvtImage *
+mvt_decoder_download_image(MvtDecoder *decoder, MvtImage *image)
+{
+    const VideoFormat format = video_format_normalize(image->format);
+    MvtImage *dst_image = decoder->download_image;
+
+    if (!dst_image || (dst_image->format != format ||
+            dst_image->width != image->width ||
+            dst_image->height != image->height)) {
+        mvt_image_pool_releasep(decoder->image_pool,
+            &decoder->download_image);
+        dst_image = mvt_image_pool_acquire(decoder->image_pool, format,
+            image->width, image->height);
+        if (!dst_image)
+            goto error_alloc_image;
+        decoder->download_image = dst_image;
+    }
+    if (!mvt_image_convert_full(dst_image, image, MVT_IMAGE_FLAG_FROM_USWC))
+        goto error_download_image;
+    return dst_image;
+
+    /* ERRORS */
+error_alloc_image:
+    mvt_error("failed to allocate image for download");
+    return NULL;
+error_download_image:
+    mvt_error("failed to download image");
+    return NULL;
 }
 
 // Hashes the supplied image and reports result
@@ -333,6 +430,20 @@ mvt_decoder_handle_image(MvtDecoder *decoder, MvtImage *image, uint32_t flags)
     if (options->benchmark)
         goto done;
 
+    /* Images in USWC memory are hashed while they are read, unless the
+       raw output needs them. They are downloaded as a whole otherwise */
+    if (flags & MVT_IMAGE_FLAG_FROM_USWC) {
+        if (decoder->hash && decoder->report && !decoder->output_file &&
+            mvt_image_hash_full(image, decoder->hash, flags)) {
+            mvt_report_write_image_hash(decoder->report, image,
+                decoder->hash, 0);
+            goto done;
+        }
+        image = mvt_decoder_download_image(decoder, image);
+        if (!image)
+            return false;
+    }
+
     if (decoder->hash && decoder->report) {
         if (!mvt_image_hash(image, decoder->hash))
             return false;
@@ -359,7 +470,11 @@ mvt_decoder_handle_image(MvtDecoder *decoder, MvtImage *image, uint32_t flags)
             if (!mvt_image_file_write_headers(decoder->output_file, info))
                 return false;
         }
-        if (!mvt_image_file_write_image(decoder->output_file, image))
+        if (decoder->output_writer) {
+            if (!mvt_image_writer_push(decoder->output_writer, image))
+                return false;
+        }
+        else if (!mvt_image_file_write_image(decoder->output_file, image))
             return false;
     }
 
@@ -437,12 +552,16 @@ main(int argc, char *argv[])
 {
     MvtDecoder *decoder;
     bool success = false;
+    uint64_t num_allocs;
 
     decoder = mvt_decoder_new();
     if (!decoder || !mvt_decoder_init(decoder, argc, argv))
         goto cleanup;
+    num_allocs = mem_get_num_allocs();
     if (!mvt_decoder_run(decoder))
         goto cleanup;
+    mvt_info("made %" PRIu64 " heap allocations while decoding",
+        mem_get_num_allocs() - num_allocs);
     mvt_decoder_dump_config(decoder);
     success = true;
 
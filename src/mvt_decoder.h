@@ -27,6 +27,8 @@
 #include "mvt_report.h"
 #include "mvt_codec.h"
 #include "mvt_image_file.h"
+#include "mvt_image_pool.h"
+#include "mvt_image_writer.h"
 
 MVT_BEGIN_DECLS
 
@@ -60,6 +62,8 @@ typedef struct {
     MvtHashType hash_type;      ///< Codec hash type to use
     MvtHwaccel hwaccel;         ///< Hardware acceleration mode
     bool benchmark;             ///< Flag: benchmark mode (decode-only)
+    char *numa_policy;          ///< NUMA placement policy
+    uint32_t output_queue_depth; ///< Number of frames queued for output
 } MvtDecoderOptions;
 
 /** Base decoder object */
@@ -73,6 +77,9 @@ typedef struct {
     uint32_t max_height;        ///< Max decoded height in pixels
     MvtImageFile *output_file;  ///< Raw video output file
     MvtImageInfo output_info;   ///< Raw video output info
+    MvtImageWriter *output_writer; ///< Raw video output writer thread
+    MvtImagePool *image_pool;   ///< Pool of images, e.g. across resizes
+    MvtImage *download_image;   ///< Image downloaded from USWC memory
     uint32_t num_frames;        ///< Number of frames handled
 } MvtDecoder;
 
@@ -94,7 +101,13 @@ typedef struct {
 const MvtDecoderClass *
 mvt_decoder_class(void);
 
-/** Hashes the supplied image and reports result */
+/**
+ * Hashes the supplied image and reports result
+ *
+ * With #MVT_IMAGE_FLAG_FROM_USWC, the image lives in USWC memory, e.g. a
+ * mapped VA surface. It is then hashed while it is read, and it is only
+ * downloaded when the raw output needs it.
+ */
 bool
 mvt_decoder_handle_image(MvtDecoder *decoder, MvtImage *image, uint32_t flags);
 
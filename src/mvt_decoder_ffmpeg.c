@@ -35,6 +35,10 @@ init_context(MvtDecoderFFmpeg *dec, AVCodecContext *avctx)
 
     dec->avctx = avctx;
     avctx->opaque = dec;
+#if FFMPEG_HAS_REFCOUNTED_FRAMES
+    // Decoded frames can then be kept beyond the next decode call
+    avctx->refcounted_frames = 1;
+#endif
     if (klass->init_context && !klass->init_context(MVT_DECODER(dec)))
         return false;
     return true;
@@ -202,8 +206,15 @@ decode_packet(MvtDecoderFFmpeg *dec, AVPacket *packet, int *got_frame_ptr)
     ret = avcodec_decode_video2(dec->avctx, dec->frame, got_frame_ptr, packet);
     if (ret < 0)
         goto error_decode_frame;
-    if (*got_frame_ptr && !handle_frame(dec, dec->frame))
-        return false;
+    if (*got_frame_ptr) {
+        const bool success = handle_frame(dec, dec->frame);
+#if FFMPEG_HAS_REFCOUNTED_FRAMES
+        if (dec->avctx->refcounted_frames)
+            av_frame_unref(dec->frame);
+#endif
+        if (!success)
+            return false;
+    }
     return true;
 
     /* ERRORS */
@@ -266,13 +277,24 @@ mvt_decoder_ffmpeg_class_init(MvtDecoderFFmpegClass *klass, uint32_t size)
     dec_class->run = (MvtDecoderRunFunc)decoder_run;
 }
 
+#if FFMPEG_HAS_REFCOUNTED_FRAMES
+// Releases the frame reference held by a wrapped image
+static void
+release_frame(void *user_data)
+{
+    AVFrame *frame = user_data;
+
+    av_frame_free(&frame);
+}
+#endif
+
 bool
 mvt_decoder_ffmpeg_handle_frame(MvtDecoderFFmpeg *dec, AVFrame *frame)
 {
     VideoFormat format;
     VAImage va_image;
     const VAImageFormat *va_format;
-    MvtImage src_image;
+    MvtImage src_image, *image;
     uint32_t i;
     bool success;
 
@@ -295,11 +317,31 @@ mvt_decoder_ffmpeg_handle_frame(MvtDecoderFFmpeg *dec, AVFrame *frame)
     if (!mvt_image_init_from_va_image(&src_image, &va_image))
         goto error_unsupported_image;
 
+#if FFMPEG_HAS_REFCOUNTED_FRAMES
+    /* Hold a reference to the frame buffers, so that the image can be
+       handed over to other threads with no copy */
+    frame = av_frame_clone(frame);
+    if (!frame)
+        goto error_ref_frame;
+#endif
+
     for (i = 0; i < va_image.num_planes; i++)
         src_image.pixels[i] = frame->data[i];
 
-    success = mvt_decoder_handle_image(&dec->base, &src_image, 0);
+#if FFMPEG_HAS_REFCOUNTED_FRAMES
+    image = mvt_image_new_wrapped(&src_image, release_frame, frame);
     mvt_image_clear(&src_image);
+    if (!image) {
+        av_frame_free(&frame);
+        goto error_ref_frame;
+    }
+    success = mvt_decoder_handle_image(&dec->base, image, 0);
+    mvt_image_unref(image);
+#else
+    image = &src_image;
+    success = mvt_decoder_handle_image(&dec->base, image, 0);
+    mvt_image_clear(image);
+#endif
     return success;
 
     /* ERRORS */
@@ -310,4 +352,10 @@ error_unsupported_format:
 error_unsupported_image:
     mvt_error("failed to extract image from frame %p", frame);
     return false;
+#if FFMPEG_HAS_REFCOUNTED_FRAMES
+error_ref_frame:
+    mvt_error("failed to reference frame %p", frame);
+    mvt_image_clear(&src_image);
+    return false;
+#endif
 }
@@ -218,11 +218,15 @@ adler32_update_ssse3(MvtHashAdler32 *hash, const uint8_t *buf, uint32_t len)
 
     ADLER32_UNPACK(hash, s1, s2);
 
+    // Short buffers may end before the next 16-byte boundary
     rlen = (((uintptr_t)buf + 0x0f) & ~0x0fUL) - (uintptr_t)buf;
+    rlen = MVT_MIN(rlen, len);
     if (rlen & 0x01) { DO1(buf, 0); buf++; }
     if (rlen & 0x02) { DO2(buf, 0); buf += 2; }
     if (rlen & 0x04) { DO4(buf, 0); buf += 4; }
     if (rlen & 0x08) { DO8(buf, 0); buf += 8; }
+    s1 %= ADLER32_BASE;
+    s2 %= ADLER32_BASE;
 
     len -= rlen;
     while (len >= 16) {
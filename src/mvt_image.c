@@ -21,6 +21,7 @@
  */
 
 #include "sysdeps.h"
+#include <pthread.h>
 #include "mvt_image.h"
 #include "mvt_image_priv.h"
 #include "mvt_memory.h"
@@ -28,6 +29,15 @@
 // Define the image data alignment so that to possibly enable SIMD optimizations
 #define MVT_IMAGE_DATA_ALIGN (32)
 
+// Maximum number of released wrapped images kept for reuse
+#define MAX_FREE_WRAPPED_IMAGES (16)
+
+/* Released wrapped images, along with their private data, so that
+   wrapping a new frame makes no heap allocation in steady state */
+static MvtImage *g_free_images[MAX_FREE_WRAPPED_IMAGES];
+static uint32_t g_num_free_images;
+static pthread_mutex_t g_free_images_lock = PTHREAD_MUTEX_INITIALIZER;
+
 // Ensures private image data is allocated
 MvtImagePrivate *
 mvt_image_priv_ensure(MvtImage *image)
@@ -36,7 +46,7 @@ mvt_image_priv_ensure(MvtImage *image)
         return NULL;
 
     if (MVT_UNLIKELY(!image->priv))
-        image->priv = calloc(1, sizeof(MvtImagePrivate));
+        image->priv = mem_calloc(1, sizeof(MvtImagePrivate));
     return image->priv;
 }
 
@@ -50,10 +60,15 @@ mvt_image_priv_clear(MvtImage *image)
         return;
 
     priv = image->priv;
-    mem_freep(&priv->hash_data);
-    priv->hash_data_size = 0;
-    mem_freep(&priv->copy_cache);
-    priv->copy_cache_size = 0;
+    if (priv->release_func) {
+        priv->release_func(priv->release_data);
+        priv->release_func = NULL;
+    }
+    if (priv->data_base_size > 0) {
+        mem_free_huge(priv->data_base, priv->data_base_size);
+        priv->data_base = NULL;
+        priv->data_base_size = 0;
+    }
     mem_freep(&priv->data_base);
     mem_freep(&image->priv);
 }
@@ -66,13 +81,26 @@ mvt_image_copy_struct(MvtImage *dst_image, MvtImage *src_image)
     dst_image->priv = NULL;
 }
 
+// Determines whether large images are backed by huge pages (MVT_HUGE_PAGES)
+static bool
+use_huge_pages(void)
+{
+    static int huge_pages = -1;
+
+    if (huge_pages < 0) {
+        const char * const str = getenv("MVT_HUGE_PAGES");
+        huge_pages = str && *str && strcmp(str, "0") != 0;
+    }
+    return huge_pages;
+}
+
 // Creates a new MvtImage object and allocates data for it
 MvtImage *
 mvt_image_new(VideoFormat format, uint32_t width, uint32_t height)
 {
     MvtImage *image;
 
-    image = malloc(sizeof(*image));
+    image = mem_alloc(sizeof(*image));
     if (!image)
         return NULL;
 
@@ -81,9 +109,15 @@ mvt_image_new(VideoFormat format, uint32_t width, uint32_t height)
 
     if (!mvt_image_priv_ensure(image))
         goto error;
+    image->priv->ref_count = 1;
 
-    image->priv->data_base = mem_alloc_aligned(image->data_size,
-        MVT_IMAGE_DATA_ALIGN);
+    // Frames of a few MB otherwise suffer from TLB misses in full scans
+    if (image->data_size >= MEM_HUGE_PAGE_SIZE && use_huge_pages())
+        image->priv->data_base = mem_alloc_huge(image->data_size,
+            &image->priv->data_base_size);
+    if (!image->priv->data_base)
+        image->priv->data_base = mem_alloc_aligned(image->data_size,
+            MVT_IMAGE_DATA_ALIGN);
     if (!image->priv->data_base)
         goto error;
 
@@ -97,6 +131,98 @@ error:
     return NULL;
 }
 
+// Reuses a released wrapped image, or allocates a new one
+static MvtImage *
+wrapped_image_alloc(void)
+{
+    MvtImage *image = NULL;
+
+    pthread_mutex_lock(&g_free_images_lock);
+    if (g_num_free_images > 0)
+        image = g_free_images[--g_num_free_images];
+    pthread_mutex_unlock(&g_free_images_lock);
+    if (image)
+        return image;
+
+    image = mem_alloc(sizeof(*image));
+    if (image)
+        image->priv = NULL;
+    return image;
+}
+
+// Releases the pixels of a wrapped image, and keeps it for reuse if possible
+static bool
+wrapped_image_recycle(MvtImage *image)
+{
+    MvtImagePrivate * const priv = image->priv;
+    bool success = false;
+
+    priv->release_func(priv->release_data);
+    memset(priv, 0, sizeof(*priv));
+
+    pthread_mutex_lock(&g_free_images_lock);
+    if (g_num_free_images < MAX_FREE_WRAPPED_IMAGES) {
+        g_free_images[g_num_free_images++] = image;
+        success = true;
+    }
+    pthread_mutex_unlock(&g_free_images_lock);
+    return success;
+}
+
+// Creates a new MvtImage object wrapping the pixels of an image
+MvtImage *
+mvt_image_new_wrapped(MvtImage *src_image, MvtImageReleaseFunc release_func,
+    void *user_data)
+{
+    MvtImagePrivate *priv;
+    MvtImage *image;
+
+    if (!src_image)
+        return NULL;
+
+    image = wrapped_image_alloc();
+    if (!image)
+        return NULL;
+
+    priv = image->priv;
+    mvt_image_copy_struct(image, src_image);
+    image->priv = priv;
+    image->data = NULL; // the wrapped frame owns the underlying data
+
+    if (!mvt_image_priv_ensure(image))
+        goto error;
+    image->priv->ref_count = 1;
+    image->priv->release_func = release_func;
+    image->priv->release_data = user_data;
+    return image;
+
+error:
+    mvt_image_free(image);
+    return NULL;
+}
+
+// Adds a reference to an MvtImage object created with mvt_image_new*()
+MvtImage *
+mvt_image_ref(MvtImage *image)
+{
+    mvt_return_val_if_fail(image && image->priv, NULL);
+
+    __sync_add_and_fetch(&image->priv->ref_count, 1);
+    return image;
+}
+
+// Drops a reference to an MvtImage object, and frees it on the last one
+void
+mvt_image_unref(MvtImage *image)
+{
+    if (!image)
+        return;
+
+    mvt_return_if_fail(image->priv != NULL);
+    if (__sync_sub_and_fetch(&image->priv->ref_count, 1) == 0)
+        mvt_image_free(image);
+}
+
 // Deallocates MvtImage object and any associated data from it
 void
 mvt_image_free(MvtImage *image)
@@ -104,6 +230,10 @@ mvt_image_free(MvtImage *image)
     if (!image)
         return;
 
+    if (image->priv && image->priv->release_func &&
+        wrapped_image_recycle(image))
+        return;
+
     mvt_image_clear(image);
     free(image);
 }
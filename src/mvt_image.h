@@ -57,10 +57,34 @@ enum {
     MVT_IMAGE_FLAG_FROM_USWC = 1 << 31,
 };
 
+/** Function called to release the pixels wrapped by an MvtImage object */
+typedef void (*MvtImageReleaseFunc)(void *user_data);
+
 /** Creates a new MvtImage object and allocates data for it */
 MvtImage *
 mvt_image_new(VideoFormat format, uint32_t width, uint32_t height);
 
+/**
+ * \brief Creates a new MvtImage object wrapping the pixels of an image.
+ *
+ * The new object refers to the same pixels as \ref src_image, typically
+ * a view over decoder-owned memory, with no copy. The \ref release_func
+ * function is called with \ref user_data once the last reference to
+ * the object is dropped, e.g. to release the decoded frame. The object
+ * can thus outlive the decoder callback that provided the frame.
+ */
+MvtImage *
+mvt_image_new_wrapped(MvtImage *src_image, MvtImageReleaseFunc release_func,
+    void *user_data);
+
+/** Adds a reference to an MvtImage object created with mvt_image_new*() */
+MvtImage *
+mvt_image_ref(MvtImage *image);
+
+/** Drops a reference to an MvtImage object, and frees it on the last one */
+void
+mvt_image_unref(MvtImage *image);
+
 /** Deallocates MvtImage object and any associated data from it */
 void
 mvt_image_free(MvtImage *image);
@@ -120,6 +144,18 @@ mvt_image_convert_full(MvtImage *image, MvtImage *src_image, uint32_t flags);
 bool
 mvt_image_hash(MvtImage *image, MvtHash *hash);
 
+/**
+ * Computes the checksum from the supplied MvtImage object, with flags
+ *
+ * With #MVT_IMAGE_FLAG_FROM_USWC, the image is read from USWC memory
+ * through a small bounce buffer, and the checksum is the one of the image
+ * converted to its normalized format. This avoids downloading the whole
+ * image first. Only NV12 and I420 images are supported in that mode, and
+ * false is returned otherwise.
+ */
+bool
+mvt_image_hash_full(MvtImage *image, MvtHash *hash, uint32_t flags);
+
 MVT_END_DECLS
 
 #endif /* MVT_IMAGE_H */
@@ -25,14 +25,41 @@
 #include "mvt_image.h"
 #include "mvt_image_priv.h"
 #include "mvt_image_compare.h"
+#include "mvt_image_simd.h"
+#include "mvt_memory.h"
 
 typedef bool (*MvtImageCompareFunc)(MvtImage *image, MvtImage *ref_image,
-    uint32_t flags, double *val);
+    uint32_t flags, MvtImageCompareInfo *info, double *val);
+
+static bool
+image_compare_psnr(MvtImage *image, MvtImage *ref_image, uint32_t flags,
+    MvtImageCompareInfo *info, double *psnr_ptr);
+
+static bool
+image_compare_exact(MvtImage *image, MvtImage *ref_image, uint32_t flags,
+    MvtImageCompareInfo *info, double *num_diffs_ptr);
+
+static bool
+image_compare_max_diff(MvtImage *image, MvtImage *ref_image, uint32_t flags,
+    MvtImageCompareInfo *info, double *max_diff_ptr);
+
+static bool
+image_compare_mismatch(MvtImage *image, MvtImage *ref_image, uint32_t flags,
+    MvtImageCompareInfo *info, double *mismatch_ptr);
 
 // Compares two images with the supplied quality metric
 bool
 mvt_image_compare(MvtImage *image, MvtImage *ref_image,
     MvtImageQualityMetric metric, double *value_ptr)
+{
+    return mvt_image_compare_full(image, ref_image, metric, NULL, value_ptr);
+}
+
+// Compares two images with the supplied metric, and extra side outputs
+bool
+mvt_image_compare_full(MvtImage *image, MvtImage *ref_image,
+    MvtImageQualityMetric metric, MvtImageCompareInfo *info,
+    double *value_ptr)
 {
     const VideoFormatInfo *vip, *ref_vip;
     MvtImageCompareFunc image_compare_func;
@@ -57,13 +84,22 @@ mvt_image_compare(MvtImage *image, MvtImage *ref_image,
         flags |= MVT_IMAGE_QUALITY_METRIC_FLAG_Y_PSNR;
         // fall-through
     case MVT_IMAGE_QUALITY_METRIC_PSNR:
-        image_compare_func = mvt_image_compare_psnr;
+        image_compare_func = image_compare_psnr;
+        break;
+    case MVT_IMAGE_QUALITY_METRIC_EXACT:
+        image_compare_func = image_compare_exact;
+        break;
+    case MVT_IMAGE_QUALITY_METRIC_MAX_DIFF:
+        image_compare_func = image_compare_max_diff;
+        break;
+    case MVT_IMAGE_QUALITY_METRIC_MISMATCH:
+        image_compare_func = image_compare_mismatch;
         break;
     default:
         assert(0 && "unsupported image quality metric");
         return false;
     }
-    return image_compare_func(image, ref_image, flags, value_ptr);
+    return image_compare_func(image, ref_image, flags, info, value_ptr);
 }
 
 // Computes the squared error
@@ -82,18 +118,12 @@ calc_psnr(uint64_t se, uint32_t num_samples, uint32_t max_intensity)
         10.0 * log10((double)se / num_samples)) : INFINITY;
 }
 
-// Compares two images with the PSNR metric
-bool
-mvt_image_compare_psnr(MvtImage *image, MvtImage *ref_image, uint32_t flags,
-    double *psnr_ptr)
+// Determines the number of components to compare and their bit depth
+static bool
+get_compare_params(const VideoFormatInfo *vip, const VideoFormatInfo *ref_vip,
+    uint32_t flags, uint32_t *num_components_ptr, uint32_t *bit_depth_ptr)
 {
-    const VideoFormatInfo * const vip =
-        video_format_get_info(image->format);
-    const VideoFormatInfo * const ref_vip =
-        video_format_get_info(ref_image->format);
-    uint32_t max_intensity, bit_depth = 0, ref_bit_depth = 0;
-    uint32_t i, j, w, h, n, num_components, num_samples = 0;
-    uint64_t se = 0;
+    uint32_t n, num_components, bit_depth = 0, ref_bit_depth = 0;
 
     if (vip->chroma_w_shift != ref_vip->chroma_w_shift ||
         vip->chroma_h_shift != ref_vip->chroma_h_shift)
@@ -103,7 +133,7 @@ mvt_image_compare_psnr(MvtImage *image, MvtImage *ref_image, uint32_t flags,
 
     // Limit comparison range for Y-PSNR
     if (flags & MVT_IMAGE_QUALITY_METRIC_FLAG_Y_PSNR) {
-        if (!video_format_is_yuv(image->format))
+        if (!video_format_is_yuv(vip->format))
             return false;
         num_components = 1;
     }
@@ -127,55 +157,1060 @@ mvt_image_compare_psnr(MvtImage *image, MvtImage *ref_image, uint32_t flags,
     }
     if (bit_depth != ref_bit_depth)
         return false;
-    max_intensity = (1U << bit_depth) - 1;
 
-    // Compare main components
-    for (n = 0; n < num_components; n++) {
-        const VideoFormatComponentInfo * const cip =
-            &vip->components[n];
-        const VideoFormatComponentInfo * const ref_cip =
-            &ref_vip->components[n];
+    *num_components_ptr = num_components;
+    *bit_depth_ptr = bit_depth;
+    return true;
+}
+
+// Determines the image holding the extra alpha component, if any
+static bool
+get_alpha_image(MvtImage *image, const VideoFormatInfo *vip,
+    MvtImage *ref_image, const VideoFormatInfo *ref_vip,
+    uint32_t num_components, MvtImage **a_image_ptr,
+    const VideoFormatInfo **a_vip_ptr)
+{
+    *a_image_ptr = NULL;
+    *a_vip_ptr = NULL;
+
+    if (!video_format_has_alpha(image->format) || num_components < 2)
+        return true;
+
+    if (vip->num_components == 3 && ref_vip->num_components == 4)
+        *a_image_ptr = ref_image, *a_vip_ptr = ref_vip;
+    else if (vip->num_components == 4 && ref_vip->num_components == 3)
+        *a_image_ptr = image, *a_vip_ptr = vip;
+    else if (vip->num_components != ref_vip->num_components ||
+             vip->num_components != num_components)
+        return false;
+    return true;
+}
+
+// Determines the size of the supplied component
+static inline void
+get_component_size(MvtImage *image, const VideoFormatInfo *vip, uint32_t n,
+    uint32_t *w_ptr, uint32_t *h_ptr)
+{
+    uint32_t w = image->width, h = image->height;
+
+    if (n > 0) {
+        w = (w + (1U << vip->chroma_w_shift) - 1) >> vip->chroma_w_shift;
+        h = (h + (1U << vip->chroma_h_shift) - 1) >> vip->chroma_h_shift;
+    }
+    *w_ptr = w;
+    *h_ptr = h;
+}
+
+/* ------------------------------------------------------------------------ */
+/* --- PSNR                                                             --- */
+/* ------------------------------------------------------------------------ */
+
+// State of the comparison of a row of samples
+typedef struct {
+    uint64_t            se;             // sum of squared errors
+    uint8_t *           diff_row;       // amplified |diff| row, or NULL
+    uint32_t            diff_scale;     // amplification factor
+    uint64_t *          block_se;       // squared errors per block, or NULL
+    MvtImageDiffStats * stats;          // |diff| statistics, or NULL
+    uint32_t            tolerance;      // max |diff| not counted as mismatch
+} RowCompare;
+
+// Accounts the supplied absolute difference into the statistics
+static inline void
+stats_add_diff(MvtImageDiffStats *stats, uint32_t d, uint32_t tolerance)
+{
+    stats->hist[MVT_MIN(d, MVT_IMAGE_COMPARE_HIST_BINS - 1)]++;
+    stats->max_diff = MVT_MAX(stats->max_diff, d);
+    if (d > tolerance)
+        stats->num_mismatches++;
+}
+
+/* Compares a row of samples with arbitrary layouts (C version). The
+   p_shift and q_shift counts locate the sample bits within 16-bit units */
+static void
+compare_row_c(RowCompare *rc, const uint8_t *p, uint32_t p_stride,
+    uint32_t p_shift, const uint8_t *q, uint32_t q_stride, uint32_t q_shift,
+    uint32_t x, uint32_t w, uint32_t bpc, uint32_t mask)
+{
+    uint32_t v, r, d, se;
+
+    for (; x < w; x++) {
+        if (bpc == 1) {
+            v = p[x * p_stride];
+            r = q[x * q_stride];
+        }
+        else {
+            v = (*(const uint16_t *)(p + x * p_stride) >> p_shift) & mask;
+            r = (*(const uint16_t *)(q + x * q_stride) >> q_shift) & mask;
+        }
+        d = v > r ? v - r : r - v;
+        se = calc_se(v, r);
+        rc->se += se;
+        if (rc->block_se)
+            rc->block_se[x / MVT_IMAGE_COMPARE_BLOCK_SIZE] += se;
+        if (rc->stats)
+            stats_add_diff(rc->stats, d, rc->tolerance);
+        if (!rc->diff_row)
+            continue;
+        d = MVT_MIN(d * rc->diff_scale, mask);
+        if (bpc == 1)
+            rc->diff_row[x] = d;
+        else
+            ((uint16_t *)rc->diff_row)[x] = d;
+    }
+}
+
+#if USE_SSE2
+// Computes the sum of the 32-bit lanes
+static inline uint32_t
+OPT_TARGET("sse2")
+hsum_epi32(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1,0,3,2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2,3,0,1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+// Computes the maximum of the unsigned 8-bit lanes
+static inline uint32_t
+OPT_TARGET("sse2")
+hmax_epu8(__m128i v)
+{
+    v = _mm_max_epu8(v, _mm_srli_si128(v, 8));
+    v = _mm_max_epu8(v, _mm_srli_si128(v, 4));
+    v = _mm_max_epu8(v, _mm_srli_si128(v, 2));
+    v = _mm_max_epu8(v, _mm_srli_si128(v, 1));
+    return _mm_cvtsi128_si32(v) & 0xff;
+}
+
+// Histogram of 8-bit |diff| values, with 8-bit counters for bins 1..16
+typedef struct {
+    __m128i             bins[MVT_IMAGE_COMPARE_HIST_BINS - 2];
+    __m128i             max_diff;
+    uint32_t            num_samples;
+    uint32_t            num_zeros;
+    uint32_t            num_mismatches;
+} Hist8;
+
+// Accounts a vector of absolute differences into the histogram
+static inline void
+MVT_ALWAYS_INLINE
+OPT_TARGET("sse2")
+hist8_add(Hist8 *hist, __m128i d, __m128i tolerance)
+{
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t i, bits;
+
+    hist->num_samples += 16;
+    bits = _mm_movemask_epi8(_mm_cmpeq_epi8(d, zero));
+    hist->num_zeros += __builtin_popcount(bits);
+    if (MVT_LIKELY(bits == 0xffff))
+        return;
+
+    hist->max_diff = _mm_max_epu8(hist->max_diff, d);
+    bits = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(d, tolerance),
+        zero));
+    hist->num_mismatches += 16 - __builtin_popcount(bits);
+    for (i = 0; i < MVT_ARRAY_LENGTH(hist->bins); i++)
+        hist->bins[i] = _mm_sub_epi8(hist->bins[i],
+            _mm_cmpeq_epi8(d, _mm_set1_epi8(i + 1)));
+}
+
+// Flushes the histogram counters into the statistics
+static void
+OPT_TARGET("sse2")
+hist8_flush(Hist8 *hist, MvtImageDiffStats *stats)
+{
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t i, count, num_samples = hist->num_zeros;
+    __m128i v;
+
+    for (i = 0; i < MVT_ARRAY_LENGTH(hist->bins); i++) {
+        v = _mm_sad_epu8(hist->bins[i], zero);
+        count = _mm_cvtsi128_si32(_mm_add_epi64(v, _mm_srli_si128(v, 8)));
+        stats->hist[i + 1] += count;
+        num_samples += count;
+        hist->bins[i] = zero;
+    }
+    stats->hist[0] += hist->num_zeros;
+    stats->hist[MVT_IMAGE_COMPARE_HIST_BINS - 1] +=
+        hist->num_samples - num_samples;
+    stats->num_mismatches += hist->num_mismatches;
+    stats->max_diff = MVT_MAX(stats->max_diff, hmax_epu8(hist->max_diff));
+    hist->num_samples = hist->num_zeros = hist->num_mismatches = 0;
+}
+
+/* Compares a row of 8-bit samples (SSE2 version). The p and q pointers
+   point to the start of the pixel units, and samples are deinterleaved
+   in registers. Vectors of 16 samples match the blocks of the error
+   map, and the squared errors and histogram bins are accumulated in
+   32-bit and 8-bit lanes respectively, over 255 vectors at most */
+static inline void
+MVT_ALWAYS_INLINE
+OPT_TARGET("sse2")
+compare_row8_sse2(RowCompare *rc, const uint8_t *p, uint32_t p_stride,
+    uint32_t p_offset, const uint8_t *q, uint32_t q_stride, uint32_t q_offset,
+    uint32_t w)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i c255 = _mm_set1_epi16(255);
+    const __m128i scale = _mm_set1_epi16(MVT_MIN(rc->diff_scale, 255));
+    const __m128i tolerance = _mm_set1_epi8(MVT_MIN(rc->tolerance, 255));
+    __m128i a, b, d, lo, hi, se, acc;
+    uint32_t x = 0, end;
+    Hist8 hist;
+
+    if (rc->stats)
+        memset(&hist, 0, sizeof(hist));
 
-        w = image->width;
-        h = image->height;
-        if (n > 0) {
-            w = (w + (1U << vip->chroma_w_shift) - 1) >> vip->chroma_w_shift;
-            h = (h + (1U << vip->chroma_h_shift) - 1) >> vip->chroma_h_shift;
+    while (x + 16 <= w) {
+        end = x + MVT_MIN((w - x) & ~15U, 16 * 255);
+        acc = zero;
+        for (; x < end; x += 16) {
+            a = load_samples8(p + x * p_stride, p_stride, p_offset);
+            b = load_samples8(q + x * q_stride, q_stride, q_offset);
+            d = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+            lo = _mm_unpacklo_epi8(d, zero);
+            hi = _mm_unpackhi_epi8(d, zero);
+            se = _mm_add_epi32(_mm_madd_epi16(lo, lo),
+                _mm_madd_epi16(hi, hi));
+            acc = _mm_add_epi32(acc, se);
+            if (rc->block_se)
+                rc->block_se[x / MVT_IMAGE_COMPARE_BLOCK_SIZE] +=
+                    hsum_epi32(se);
+            if (rc->diff_row) {
+                lo = _mm_mullo_epi16(lo, scale);
+                hi = _mm_mullo_epi16(hi, scale);
+                lo = _mm_sub_epi16(lo, _mm_subs_epu16(lo, c255));
+                hi = _mm_sub_epi16(hi, _mm_subs_epu16(hi, c255));
+                _mm_storeu_si128((__m128i *)(rc->diff_row + x),
+                    _mm_packus_epi16(lo, hi));
+            }
+            if (rc->stats)
+                hist8_add(&hist, d, tolerance);
         }
+        rc->se += hsum_epi32(acc);
+        if (rc->stats)
+            hist8_flush(&hist, rc->stats);
+    }
+    compare_row_c(rc, p + p_offset, p_stride, 0, q + q_offset, q_stride, 0,
+        x, w, 1, 0xff);
+}
+
+typedef void (*CompareRow8Func)(RowCompare *rc, const uint8_t *p,
+    uint32_t p_offset, const uint8_t *q, uint32_t q_offset, uint32_t w);
+
+// Defines a compare function specialized for the supplied strides
+#define DEFINE_COMPARE_ROW8(P_STRIDE, Q_STRIDE)                         \
+static void                                                             \
+OPT_TARGET("sse2")                                                      \
+MVT_GEN_CONCAT4(compare_row8_,P_STRIDE,_,Q_STRIDE)(RowCompare *rc,      \
+    const uint8_t *p, uint32_t p_offset, const uint8_t *q,              \
+    uint32_t q_offset, uint32_t w)                                      \
+{                                                                       \
+    compare_row8_sse2(rc, p, P_STRIDE, p_offset, q, Q_STRIDE, q_offset, \
+        w);                                                             \
+}
+
+DEFINE_COMPARE_ROW8(1, 1)
+DEFINE_COMPARE_ROW8(1, 2)
+DEFINE_COMPARE_ROW8(1, 4)
+DEFINE_COMPARE_ROW8(2, 1)
+DEFINE_COMPARE_ROW8(2, 2)
+DEFINE_COMPARE_ROW8(2, 4)
+DEFINE_COMPARE_ROW8(4, 1)
+DEFINE_COMPARE_ROW8(4, 2)
+DEFINE_COMPARE_ROW8(4, 4)
+
+#undef DEFINE_COMPARE_ROW8
+
+// Compare functions, indexed by the log2 of the source/reference strides
+static const CompareRow8Func compare_row8_funcs[3][3] = {
+    { compare_row8_1_1, compare_row8_1_2, compare_row8_1_4 },
+    { compare_row8_2_1, compare_row8_2_2, compare_row8_2_4 },
+    { compare_row8_4_1, compare_row8_4_2, compare_row8_4_4 },
+};
+
+// Determines the index of the supplied stride into the functions table
+static inline int
+get_stride_index(uint32_t stride, uint32_t offset)
+{
+    if (offset >= stride)
+        return -1;
+
+    switch (stride) {
+    case 1: return 0;
+    case 2: return 1;
+    case 4: return 2;
+    }
+    return -1;
+}
+#endif
+
+// Compares a row of samples
+static inline void
+compare_row(RowCompare *rc, const uint8_t *p, uint32_t p_stride,
+    uint32_t p_offset, uint32_t p_shift, const uint8_t *q, uint32_t q_stride,
+    uint32_t q_offset, uint32_t q_shift, uint32_t w, uint32_t bpc,
+    uint32_t mask)
+{
+#if USE_SSE2
+    const int i = get_stride_index(p_stride, p_offset);
+    const int j = get_stride_index(q_stride, q_offset);
 
-        for (j = 0; j < h; j++) {
-            for (i = 0; i < w; i++)
-                se += calc_se(get_component(image, cip, i, j),
-                    get_component(ref_image, ref_cip, i, j));
+    if (bpc == 1 && i >= 0 && j >= 0) {
+        compare_row8_funcs[i][j](rc, p - p_offset, p_offset, q - q_offset,
+            q_offset, w);
+        return;
+    }
+#endif
+    compare_row_c(rc, p, p_stride, p_shift, q, q_stride, q_shift, 0, w, bpc,
+        mask);
+}
+
+// Stores the mean squared errors of a row of blocks into the block map
+static void
+put_block_map_row(MvtImage *block_map, const VideoFormatInfo *vip,
+    uint32_t n, uint32_t by, const uint64_t *block_se, uint32_t w,
+    uint32_t bh, uint32_t bit_depth)
+{
+    const VideoFormatComponentInfo * const cip = &vip->components[n];
+    const uint32_t shift = 2 * (bit_depth - MVT_MIN(bit_depth, 8));
+    uint32_t bx, bw, num_blocks;
+    uint64_t mse;
+
+    num_blocks = (w + MVT_IMAGE_COMPARE_BLOCK_SIZE - 1) /
+        MVT_IMAGE_COMPARE_BLOCK_SIZE;
+    for (bx = 0; bx < num_blocks; bx++) {
+        bw = MVT_MIN(w - bx * MVT_IMAGE_COMPARE_BLOCK_SIZE,
+            MVT_IMAGE_COMPARE_BLOCK_SIZE);
+        // MSE in 8.8 fixed-point, normalized to 8-bit samples
+        mse = ((block_se[bx] << 8) / (bw * bh)) >> shift;
+        put_component16(block_map, cip, bx, by, MVT_MIN(mse, 0xffff));
+    }
+}
+
+// Compares the supplied component, and fills in the side outputs
+static bool
+compare_component(MvtImage *image, const VideoFormatInfo *vip,
+    MvtImage *ref_image, const VideoFormatInfo *ref_vip, uint32_t n,
+    MvtImageCompareInfo *info, uint64_t *se_ptr)
+{
+    const VideoFormatComponentInfo * const cip = &vip->components[n];
+    const VideoFormatComponentInfo * const ref_cip = &ref_vip->components[n];
+    const uint32_t bpc = (cip->bit_depth + 7) / 8; // bytes per component
+    const uint32_t mask = (1U << cip->bit_depth) - 1;
+    MvtImage * const diff_image = info ? info->diff_image : NULL;
+    MvtImage * const block_map = info ? info->block_map : NULL;
+    MvtImageDiffStats * const stats = info && info->stats ?
+        &info->stats[n] : NULL;
+    const VideoFormatInfo *diff_vip = NULL, *map_vip = NULL;
+    const MemScratchMark mark = mem_scratch_mark();
+    const uint8_t *p, *q;
+    uint32_t y, w, h, bh, num_blocks = 0;
+    RowCompare rc;
+
+    get_component_size(image, vip, n, &w, &h);
+
+    memset(&rc, 0, sizeof(rc));
+    if (stats) {
+        rc.stats = stats;
+        rc.tolerance = info->tolerance;
+        stats->num_samples += (uint64_t)w * h;
+    }
+    if (diff_image) {
+        diff_vip = video_format_get_info(diff_image->format);
+        if (n >= diff_vip->num_components)
+            diff_vip = NULL;
+        rc.diff_scale = MVT_MAX(info->diff_scale, 1);
+    }
+    if (block_map && n < 3) {
+        map_vip = video_format_get_info(block_map->format);
+        num_blocks = (w + MVT_IMAGE_COMPARE_BLOCK_SIZE - 1) /
+            MVT_IMAGE_COMPARE_BLOCK_SIZE;
+        rc.block_se = mem_scratch_alloc(num_blocks * sizeof(*rc.block_se),
+            sizeof(*rc.block_se));
+        if (!rc.block_se)
+            return false;
+        memset(rc.block_se, 0, num_blocks * sizeof(*rc.block_se));
+    }
+
+    p = get_component_ptr(image, cip, 0, 0);
+    q = get_component_ptr(ref_image, ref_cip, 0, 0);
+    for (y = 0; y < h; y++) {
+        if (diff_vip)
+            rc.diff_row = get_component_ptr(diff_image,
+                &diff_vip->components[n], 0, y);
+        compare_row(&rc, p, cip->pixel_stride, cip->pixel_offset,
+            cip->bit_shift, q, ref_cip->pixel_stride, ref_cip->pixel_offset,
+            ref_cip->bit_shift, w, bpc, mask);
+        p += image->pitches[cip->plane];
+        q += ref_image->pitches[ref_cip->plane];
+
+        // Flush the accumulated errors at the end of each row of blocks
+        bh = y % MVT_IMAGE_COMPARE_BLOCK_SIZE + 1;
+        if (rc.block_se && (bh == MVT_IMAGE_COMPARE_BLOCK_SIZE || y == h - 1)) {
+            put_block_map_row(block_map, map_vip, n,
+                y / MVT_IMAGE_COMPARE_BLOCK_SIZE, rc.block_se, w, bh,
+                cip->bit_depth);
+            memset(rc.block_se, 0, num_blocks * sizeof(*rc.block_se));
         }
+    }
+    mem_scratch_release(&mark);
+    *se_ptr += rc.se;
+    return true;
+}
+
+// Checks the side outputs are compatible with the compared image
+static bool
+check_compare_info(MvtImageCompareInfo *info, MvtImage *image,
+    const VideoFormatInfo *vip, uint32_t bit_depth)
+{
+    const VideoFormatInfo *out_vip;
+    uint32_t n, bs = MVT_IMAGE_COMPARE_BLOCK_SIZE;
+
+    if (info->diff_image) {
+        MvtImage * const out_image = info->diff_image;
+
+        out_vip = video_format_get_info(out_image->format);
+        if (!out_vip || out_image->width != image->width ||
+            out_image->height != image->height)
+            return false;
+        if (out_vip->chroma_w_shift != vip->chroma_w_shift ||
+            out_vip->chroma_h_shift != vip->chroma_h_shift ||
+            out_vip->num_components < MVT_MIN(vip->num_components, 3))
+            return false;
+        for (n = 0; n < out_vip->num_components; n++) {
+            const VideoFormatComponentInfo * const cip =
+                &out_vip->components[n];
+            if (cip->bit_depth != bit_depth || cip->bit_shift != 0 ||
+                cip->pixel_stride != (bit_depth + 7) / 8)
+                return false;
+        }
+    }
+
+    if (info->block_map) {
+        MvtImage * const out_image = info->block_map;
+
+        out_vip = video_format_get_info(out_image->format);
+        if (!out_vip || out_image->width != (image->width + bs - 1) / bs ||
+            out_image->height != (image->height + bs - 1) / bs)
+            return false;
+        if (out_vip->chroma_w_shift != vip->chroma_w_shift ||
+            out_vip->chroma_h_shift != vip->chroma_h_shift ||
+            out_vip->num_components < MVT_MIN(vip->num_components, 3))
+            return false;
+        for (n = 0; n < out_vip->num_components; n++) {
+            if (out_vip->components[n].pixel_stride != 2)
+                return false;
+        }
+    }
+    return true;
+}
+
+// Compares two images with the PSNR metric, and extra side outputs
+static bool
+image_compare_psnr(MvtImage *image, MvtImage *ref_image, uint32_t flags,
+    MvtImageCompareInfo *info, double *psnr_ptr)
+{
+    const VideoFormatInfo * const vip =
+        video_format_get_info(image->format);
+    const VideoFormatInfo * const ref_vip =
+        video_format_get_info(ref_image->format);
+    const VideoFormatInfo *a_vip;
+    MvtImage *a_image;
+    uint32_t max_intensity, bit_depth;
+    uint32_t i, j, w, h, n, num_components, num_samples = 0;
+    uint64_t se = 0;
+
+    if (!get_compare_params(vip, ref_vip, flags, &num_components, &bit_depth))
+        return false;
+    max_intensity = (1U << bit_depth) - 1;
+
+    if (info && !check_compare_info(info, image, vip, bit_depth))
+        return false;
+    if (info && info->stats)
+        memset(info->stats, 0, 4 * sizeof(*info->stats));
+
+    // Compare main components
+    for (n = 0; n < num_components; n++) {
+        if (!compare_component(image, vip, ref_image, ref_vip, n, info, &se))
+            return false;
+        get_component_size(image, vip, n, &w, &h);
         num_samples += w * h;
     }
 
     // Compare alpha components
-    if (video_format_has_alpha(image->format) && num_components > 1) {
-        MvtImage *a_image;
-        const VideoFormatInfo *a_vip;
-
-        if (vip->num_components == 3 && ref_vip->num_components == 4)
-            a_image = ref_image, a_vip = ref_vip;
-        else if (vip->num_components == 4 && ref_vip->num_components == 3)
-            a_image = image, a_vip = vip;
-        else if (vip->num_components == ref_vip->num_components &&
-                 vip->num_components == num_components)
-            a_image = NULL;
+    if (!get_alpha_image(image, vip, ref_image, ref_vip, num_components,
+            &a_image, &a_vip))
+        return false;
+    if (a_image) {
+        const VideoFormatComponentInfo * const cip = &a_vip->components[3];
+        MvtImageDiffStats * const stats = info && info->stats ?
+            &info->stats[3] : NULL;
+        uint32_t v;
+
+        for (j = 0; j < a_image->height; j++) {
+            for (i = 0; i < a_image->width; i++) {
+                v = get_component(a_image, cip, i, j);
+                se += calc_se(v, max_intensity);
+                if (stats)
+                    stats_add_diff(stats, max_intensity - v, info->tolerance);
+            }
+        }
+        num_samples += a_image->width * a_image->height;
+        if (stats)
+            stats->num_samples += a_image->width * a_image->height;
+    }
+
+    *psnr_ptr = calc_psnr(se, num_samples, max_intensity);
+    return true;
+}
+
+// Compares two images with the PSNR metric
+bool
+mvt_image_compare_psnr(MvtImage *image, MvtImage *ref_image, uint32_t flags,
+    double *psnr_ptr)
+{
+    return image_compare_psnr(image, ref_image, flags, NULL, psnr_ptr);
+}
+
+/* ------------------------------------------------------------------------ */
+/* --- Tolerance-based comparison                                       --- */
+/* ------------------------------------------------------------------------ */
+
+// Computes the statistics of absolute differences, in a single pass
+static bool
+compute_diff_stats(MvtImage *image, MvtImage *ref_image, uint32_t flags,
+    MvtImageCompareInfo *info, MvtImageDiffStats *stats)
+{
+    MvtImageCompareInfo tmp_info;
+    double psnr;
+
+    if (info)
+        tmp_info = *info;
+    else
+        memset(&tmp_info, 0, sizeof(tmp_info));
+    if (!tmp_info.stats)
+        tmp_info.stats = stats;
+
+    if (!image_compare_psnr(image, ref_image, flags, &tmp_info, &psnr))
+        return false;
+    if (tmp_info.stats != stats)
+        memcpy(stats, tmp_info.stats, 4 * sizeof(*stats));
+    return true;
+}
+
+// Compares two images, and returns the maximum absolute difference
+static bool
+image_compare_max_diff(MvtImage *image, MvtImage *ref_image, uint32_t flags,
+    MvtImageCompareInfo *info, double *max_diff_ptr)
+{
+    MvtImageDiffStats stats[4];
+    uint32_t n, max_diff = 0;
+
+    if (!compute_diff_stats(image, ref_image, flags, info, stats))
+        return false;
+
+    for (n = 0; n < 4; n++)
+        max_diff = MVT_MAX(max_diff, stats[n].max_diff);
+    *max_diff_ptr = max_diff;
+    return true;
+}
+
+/* Compares two images, and returns the percentage of samples whose
+   absolute difference exceeds the tolerance */
+static bool
+image_compare_mismatch(MvtImage *image, MvtImage *ref_image, uint32_t flags,
+    MvtImageCompareInfo *info, double *mismatch_ptr)
+{
+    MvtImageDiffStats stats[4];
+    uint64_t num_samples = 0, num_mismatches = 0;
+    uint32_t n;
+
+    if (!compute_diff_stats(image, ref_image, flags, info, stats))
+        return false;
+
+    for (n = 0; n < 4; n++) {
+        num_samples += stats[n].num_samples;
+        num_mismatches += stats[n].num_mismatches;
+    }
+    *mismatch_ptr = num_samples > 0 ?
+        100.0 * num_mismatches / num_samples : 0.0;
+    return true;
+}
+
+/* ------------------------------------------------------------------------ */
+/* --- Bit-exact comparison                                             --- */
+/* ------------------------------------------------------------------------ */
+
+// Differences found in a row of samples
+typedef struct {
+    uint32_t            count;          // number of differing samples
+    uint32_t            first;          // column of the first difference
+    uint32_t            last;           // column of the last difference
+} RowDiffs;
+
+// Checks whether two rows of contiguous samples are identical (C version)
+static bool
+row_equal_c(const uint8_t *p, const uint8_t *q, uint32_t w, uint32_t bpc,
+    uint32_t mask)
+{
+    uint32_t i;
+
+    if (bpc == 1 || mask == 0xffff)
+        return memcmp(p, q, w * bpc) == 0;
+
+    for (i = 0; i < w; i++) {
+        if ((((const uint16_t *)p)[i] ^ ((const uint16_t *)q)[i]) & mask)
+            return false;
+    }
+    return true;
+}
+
+// Collects the differences in two rows of contiguous samples (C version)
+static void
+row_find_diffs_c(const uint8_t *p, const uint8_t *q, uint32_t x, uint32_t w,
+    uint32_t bpc, uint32_t mask, RowDiffs *diffs)
+{
+    uint32_t v;
+
+    for (; x < w; x++) {
+        if (bpc == 1)
+            v = p[x] ^ q[x];
         else
+            v = (((const uint16_t *)p)[x] ^ ((const uint16_t *)q)[x]) & mask;
+        if (!v)
+            continue;
+        if (!diffs->count++)
+            diffs->first = x;
+        diffs->last = x;
+    }
+}
+
+#if USE_SSE2
+/* Checks whether two rows of contiguous samples are identical, i.e. a
+   memcmp() that only needs to tell whether rows differ, and thus can
+   merge 64 bytes worth of XOR results before testing them */
+static bool
+OPT_TARGET("sse2")
+row_equal_sse2(const uint8_t *p, const uint8_t *q, uint32_t w, uint32_t bpc,
+    uint32_t mask)
+{
+    const __m128i m = _mm_set1_epi16(bpc == 1 ? 0xffff : mask);
+    const __m128i zero = _mm_setzero_si128();
+    const uint32_t n = w * bpc;
+    __m128i v0, v1, v2, v3;
+    uint32_t i = 0;
+
+    for (; i + 64 <= n; i += 64) {
+        v0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(p + i)),
+            _mm_loadu_si128((const __m128i *)(q + i)));
+        v1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(p + i + 16)),
+            _mm_loadu_si128((const __m128i *)(q + i + 16)));
+        v2 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(p + i + 32)),
+            _mm_loadu_si128((const __m128i *)(q + i + 32)));
+        v3 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(p + i + 48)),
+            _mm_loadu_si128((const __m128i *)(q + i + 48)));
+        v0 = _mm_and_si128(_mm_or_si128(_mm_or_si128(v0, v1),
+            _mm_or_si128(v2, v3)), m);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v0, zero)) != 0xffff)
             return false;
-        if (a_image) {
-            const VideoFormatComponentInfo * const cip = &a_vip->components[3];
-            for (j = 0; j < a_image->height; j++) {
-                for (i = 0; i < a_image->width; i++)
-                    se += calc_se(get_component(a_image, cip, i, j),
-                        max_intensity);
+    }
+    for (; i + 16 <= n; i += 16) {
+        v0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(p + i)),
+            _mm_loadu_si128((const __m128i *)(q + i)));
+        v0 = _mm_and_si128(v0, m);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v0, zero)) != 0xffff)
+            return false;
+    }
+    i /= bpc;
+    return row_equal_c(p + i * bpc, q + i * bpc, w - i, bpc, mask);
+}
+
+// Collects the differences in two rows of contiguous samples (SSE2 version)
+static void
+OPT_TARGET("sse2")
+row_find_diffs_sse2(const uint8_t *p, const uint8_t *q, uint32_t w,
+    uint32_t bpc, uint32_t mask, RowDiffs *diffs)
+{
+    const __m128i m = _mm_set1_epi16(bpc == 1 ? 0xffff : mask);
+    const __m128i zero = _mm_setzero_si128();
+    const uint32_t n = w * bpc;
+    __m128i v;
+    uint32_t i, bits;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(p + i)),
+            _mm_loadu_si128((const __m128i *)(q + i)));
+        v = _mm_and_si128(v, m);
+        v = bpc == 1 ? _mm_cmpeq_epi8(v, zero) : _mm_cmpeq_epi16(v, zero);
+        bits = ~_mm_movemask_epi8(v) & 0xffff;
+        if (!bits)
+            continue;
+        if (!diffs->count)
+            diffs->first = (i + __builtin_ctz(bits)) / bpc;
+        diffs->last = (i + 31 - __builtin_clz(bits)) / bpc;
+        diffs->count += __builtin_popcount(bits) / bpc;
+    }
+    row_find_diffs_c(p, q, i / bpc, w, bpc, mask, diffs);
+}
+
+/* Collects the differences in two rows of interleaved 8-bit samples
+   (SSE2 version). The p and q pointers point to the start of the pixel
+   units, and samples are deinterleaved in registers */
+static inline void
+MVT_ALWAYS_INLINE
+OPT_TARGET("sse2")
+row_find_diffs8_sse2(const uint8_t *p, uint32_t p_stride, uint32_t p_offset,
+    const uint8_t *q, uint32_t q_stride, uint32_t q_offset, uint32_t w,
+    RowDiffs *diffs)
+{
+    __m128i a, b;
+    uint32_t x, bits;
+
+    for (x = 0; x + 16 <= w; x += 16) {
+        a = load_samples8(p + x * p_stride, p_stride, p_offset);
+        b = load_samples8(q + x * q_stride, q_stride, q_offset);
+        bits = ~_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) & 0xffff;
+        if (MVT_LIKELY(!bits))
+            continue;
+        if (!diffs->count)
+            diffs->first = x + __builtin_ctz(bits);
+        diffs->last = x + 31 - __builtin_clz(bits);
+        diffs->count += __builtin_popcount(bits);
+    }
+
+    p += p_offset;
+    q += q_offset;
+    for (; x < w; x++) {
+        if (p[x * p_stride] == q[x * q_stride])
+            continue;
+        if (!diffs->count++)
+            diffs->first = x;
+        diffs->last = x;
+    }
+}
+
+typedef void (*RowFindDiffs8Func)(const uint8_t *p, uint32_t p_offset,
+    const uint8_t *q, uint32_t q_offset, uint32_t w, RowDiffs *diffs);
+
+// Defines a diffs collector specialized for the supplied strides
+#define DEFINE_ROW_FIND_DIFFS8(P_STRIDE, Q_STRIDE)                      \
+static void                                                             \
+OPT_TARGET("sse2")                                                      \
+MVT_GEN_CONCAT4(row_find_diffs8_,P_STRIDE,_,Q_STRIDE)(const uint8_t *p, \
+    uint32_t p_offset, const uint8_t *q, uint32_t q_offset, uint32_t w, \
+    RowDiffs *diffs)                                                    \
+{                                                                       \
+    row_find_diffs8_sse2(p, P_STRIDE, p_offset, q, Q_STRIDE, q_offset,  \
+        w, diffs);                                                      \
+}
+
+DEFINE_ROW_FIND_DIFFS8(1, 1)
+DEFINE_ROW_FIND_DIFFS8(1, 2)
+DEFINE_ROW_FIND_DIFFS8(1, 4)
+DEFINE_ROW_FIND_DIFFS8(2, 1)
+DEFINE_ROW_FIND_DIFFS8(2, 2)
+DEFINE_ROW_FIND_DIFFS8(2, 4)
+DEFINE_ROW_FIND_DIFFS8(4, 1)
+DEFINE_ROW_FIND_DIFFS8(4, 2)
+DEFINE_ROW_FIND_DIFFS8(4, 4)
+
+#undef DEFINE_ROW_FIND_DIFFS8
+
+// Diffs collectors, indexed by the log2 of the source/reference strides
+static const RowFindDiffs8Func row_find_diffs8_funcs[3][3] = {
+    { row_find_diffs8_1_1, row_find_diffs8_1_2, row_find_diffs8_1_4 },
+    { row_find_diffs8_2_1, row_find_diffs8_2_2, row_find_diffs8_2_4 },
+    { row_find_diffs8_4_1, row_find_diffs8_4_2, row_find_diffs8_4_4 },
+};
+#endif
+
+/* Checks whether two rows of contiguous samples are identical. For 16-bit
+   units, only the bits set in mask are compared */
+static inline bool
+row_equal(const uint8_t *p, const uint8_t *q, uint32_t w, uint32_t bpc,
+    uint32_t mask)
+{
+#if USE_SSE2
+    return row_equal_sse2(p, q, w, bpc, mask);
+#else
+    return row_equal_c(p, q, w, bpc, mask);
+#endif
+}
+
+// Collects the differences in two rows of contiguous samples
+static inline void
+row_find_diffs(const uint8_t *p, const uint8_t *q, uint32_t w, uint32_t bpc,
+    uint32_t mask, RowDiffs *diffs)
+{
+#if USE_SSE2
+    row_find_diffs_sse2(p, q, w, bpc, mask, diffs);
+#else
+    row_find_diffs_c(p, q, 0, w, bpc, mask, diffs);
+#endif
+}
+
+// Accounts the differences found in the specified row of component n
+static void
+report_add_row_diffs(MvtImageDiffReport *report, const VideoFormatInfo *vip,
+    uint32_t n, uint32_t y, const RowDiffs *diffs, uint32_t bbox[4])
+{
+    const uint32_t sx = n > 0 ? vip->chroma_w_shift : 0;
+    const uint32_t sy = n > 0 ? vip->chroma_h_shift : 0;
+
+    if (!report->num_diffs) {
+        report->first_component = n;
+        report->first_x = diffs->first;
+        report->first_y = y;
+    }
+    report->num_diffs += diffs->count;
+
+    bbox[0] = MVT_MIN(bbox[0], diffs->first << sx);
+    bbox[1] = MVT_MIN(bbox[1], y << sy);
+    bbox[2] = MVT_MAX(bbox[2], (diffs->last + 1) << sx);
+    bbox[3] = MVT_MAX(bbox[3], (y + 1) << sy);
+}
+
+// Compares the supplied component for bit-exactness
+static void
+compare_exact_component(MvtImage *image, const VideoFormatInfo *vip,
+    MvtImage *ref_image, const VideoFormatInfo *ref_vip, uint32_t n,
+    MvtImageDiffReport *report, uint32_t bbox[4])
+{
+    const VideoFormatComponentInfo * const cip = &vip->components[n];
+    const VideoFormatComponentInfo * const ref_cip = &ref_vip->components[n];
+    const uint32_t bpc = (cip->bit_depth + 7) / 8; // bytes per component
+    // Sample bits within 16-bit units, e.g. the 10 MSBs for P010
+    const uint32_t mask = ((1U << cip->bit_depth) - 1) << cip->bit_shift;
+    const uint8_t *p, *q;
+    uint32_t x, y, w, h;
+    RowDiffs diffs;
+#if USE_SSE2
+    int i, j;
+#endif
+
+    get_component_size(image, vip, n, &w, &h);
+    report->num_samples += (uint64_t)w * h;
+
+    p = get_component_ptr(image, cip, 0, 0);
+    q = get_component_ptr(ref_image, ref_cip, 0, 0);
+    for (y = 0; y < h; y++) {
+        memset(&diffs, 0, sizeof(diffs));
+        if (cip->pixel_stride == bpc && ref_cip->pixel_stride == bpc &&
+            cip->bit_shift == ref_cip->bit_shift) {
+            if (MVT_LIKELY(row_equal(p, q, w, bpc, mask)))
+                goto next_row;
+            row_find_diffs(p, q, w, bpc, mask, &diffs);
+        }
+#if USE_SSE2
+        else if (bpc == 1 && (i = get_stride_index(cip->pixel_stride,
+                     cip->pixel_offset)) >= 0 &&
+                 (j = get_stride_index(ref_cip->pixel_stride,
+                     ref_cip->pixel_offset)) >= 0)
+            row_find_diffs8_funcs[i][j](p - cip->pixel_offset,
+                cip->pixel_offset, q - ref_cip->pixel_offset,
+                ref_cip->pixel_offset, w, &diffs);
+#endif
+        else {
+            for (x = 0; x < w; x++) {
+                if (get_component(image, cip, x, y) ==
+                    get_component(ref_image, ref_cip, x, y))
+                    continue;
+                if (!diffs.count++)
+                    diffs.first = x;
+                diffs.last = x;
             }
-            num_samples += a_image->width * a_image->height;
         }
+        if (diffs.count > 0)
+            report_add_row_diffs(report, vip, n, y, &diffs, bbox);
+    next_row:
+        p += image->pitches[cip->plane];
+        q += ref_image->pitches[ref_cip->plane];
     }
+}
 
-    *psnr_ptr = calc_psnr(se, num_samples, max_intensity);
+// Compares two images for bit-exactness
+bool
+mvt_image_compare_exact(MvtImage *image, MvtImage *ref_image, uint32_t flags,
+    MvtImageDiffReport *report)
+{
+    const VideoFormatInfo *vip, *ref_vip, *a_vip;
+    MvtImage *a_image;
+    uint32_t i, j, n, num_components, bit_depth, max_intensity, bbox[4];
+    RowDiffs diffs;
+
+    if (!image || !ref_image || !report)
+        return false;
+    if (image->width != ref_image->width || image->height != ref_image->height)
+        return false;
+
+    vip = video_format_get_info(image->format);
+    ref_vip = video_format_get_info(ref_image->format);
+    if (!vip || !ref_vip)
+        return false;
+
+    if (!get_compare_params(vip, ref_vip, flags, &num_components, &bit_depth))
+        return false;
+    if (!get_alpha_image(image, vip, ref_image, ref_vip, num_components,
+            &a_image, &a_vip))
+        return false;
+    max_intensity = (1U << bit_depth) - 1;
+
+    memset(report, 0, sizeof(*report));
+    bbox[0] = bbox[1] = UINT32_MAX;
+    bbox[2] = bbox[3] = 0;
+
+    for (n = 0; n < num_components; n++)
+        compare_exact_component(image, vip, ref_image, ref_vip, n, report,
+            bbox);
+
+    // A missing alpha component is considered fully opaque
+    if (a_image) {
+        const VideoFormatComponentInfo * const cip = &a_vip->components[3];
+        for (j = 0; j < a_image->height; j++) {
+            memset(&diffs, 0, sizeof(diffs));
+            for (i = 0; i < a_image->width; i++) {
+                if (get_component(a_image, cip, i, j) == max_intensity)
+                    continue;
+                if (!diffs.count++)
+                    diffs.first = i;
+                diffs.last = i;
+            }
+            if (diffs.count > 0)
+                report_add_row_diffs(report, a_vip, 3, j, &diffs, bbox);
+        }
+        report->num_samples += (uint64_t)a_image->width * a_image->height;
+    }
+
+    if (report->num_diffs > 0) {
+        report->bbox.x = bbox[0];
+        report->bbox.y = bbox[1];
+        report->bbox.width = MVT_MIN(bbox[2], image->width) - bbox[0];
+        report->bbox.height = MVT_MIN(bbox[3], image->height) - bbox[1];
+    }
+    return true;
+}
+
+// Compares two images for bit-exactness, and returns the number of diffs
+static bool
+image_compare_exact(MvtImage *image, MvtImage *ref_image, uint32_t flags,
+    MvtImageCompareInfo *info, double *num_diffs_ptr)
+{
+    MvtImageDiffReport report;
+    double psnr;
+
+    // Side outputs are only produced by a full comparison pass
+    if (info && (info->diff_image || info->block_map) &&
+        !image_compare_psnr(image, ref_image, flags, info, &psnr))
+        return false;
+
+    if (!mvt_image_compare_exact(image, ref_image, flags, &report))
+        return false;
+    *num_diffs_ptr = report.num_diffs;
+    return true;
+}
+
+/* ------------------------------------------------------------------------ */
+/* --- Image fingerprints                                               --- */
+/* ------------------------------------------------------------------------ */
+
+// Sums a row of contiguous 8-bit samples
+static inline uint32_t
+sum_row8(const uint8_t *p, uint32_t w)
+{
+    uint32_t x, sum = 0;
+
+    for (x = 0; x < w; x++)
+        sum += p[x];
+    return sum;
+}
+
+// Computes the fingerprint of the supplied image
+bool
+mvt_image_get_fingerprint(MvtImage *image, MvtImageFingerprint *fp)
+{
+    const uint32_t fs = MVT_IMAGE_FINGERPRINT_SIZE;
+    const VideoFormatInfo *vip;
+    const VideoFormatComponentInfo *cip;
+    uint32_t x, y, x0, x1, y0, y1, tx, ty, shift;
+    uint64_t sum;
+    bool is_contiguous8;
+
+    if (!image || !fp)
+        return false;
+
+    vip = video_format_get_info(image->format);
+    if (!vip || vip->num_components < 1)
+        return false;
+
+    cip = &vip->components[0];
+    shift = cip->bit_depth - MVT_MIN(cip->bit_depth, 8);
+    is_contiguous8 = cip->bit_depth <= 8 && cip->pixel_stride == 1;
+
+    for (ty = 0; ty < fs; ty++) {
+        y0 = ty * image->height / fs;
+        y1 = MVT_MAX((ty + 1) * image->height / fs, y0 + 1);
+        for (tx = 0; tx < fs; tx++) {
+            x0 = tx * image->width / fs;
+            x1 = MVT_MAX((tx + 1) * image->width / fs, x0 + 1);
+            sum = 0;
+            for (y = y0; y < y1; y++) {
+                if (is_contiguous8)
+                    sum += sum_row8(get_component_ptr(image, cip, x0, y),
+                        x1 - x0);
+                else {
+                    for (x = x0; x < x1; x++)
+                        sum += get_component(image, cip, x, y);
+                }
+            }
+            sum /= (uint64_t)(x1 - x0) * (y1 - y0);
+            fp->data[ty * fs + tx] = sum >> shift;
+        }
+    }
     return true;
 }
+
+// Computes the distance between two fingerprints (C version)
+static uint32_t
+fingerprint_distance_c(const uint8_t *p, const uint8_t *q, uint32_t n)
+{
+    uint32_t i, dist = 0;
+
+    for (i = 0; i < n; i++)
+        dist += abs((int)p[i] - (int)q[i]);
+    return dist;
+}
+
+#if USE_SSE2
+// Computes the distance between two fingerprints (SSE2 version)
+static uint32_t
+OPT_TARGET("sse2")
+fingerprint_distance_sse2(const uint8_t *p, const uint8_t *q, uint32_t n)
+{
+    __m128i acc = _mm_setzero_si128();
+    uint32_t i;
+
+    for (i = 0; i < n; i += 16) {
+        const __m128i a = _mm_loadu_si128((const __m128i *)&p[i]);
+        const __m128i b = _mm_loadu_si128((const __m128i *)&q[i]);
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(a, b));
+    }
+    acc = _mm_add_epi64(acc, _mm_srli_si128(acc, 8));
+    return _mm_cvtsi128_si32(acc);
+}
+#endif
+
+// Computes the distance between two fingerprints
+uint32_t
+mvt_image_fingerprint_distance(const MvtImageFingerprint *fp,
+    const MvtImageFingerprint *ref_fp)
+{
+#if USE_SSE2
+    if (sizeof(fp->data) % 16 == 0)
+        return fingerprint_distance_sse2(fp->data, ref_fp->data,
+            sizeof(fp->data));
+#endif
+    return fingerprint_distance_c(fp->data, ref_fp->data, sizeof(fp->data));
+}
@@ -33,6 +33,12 @@ typedef enum {
     MVT_IMAGE_QUALITY_METRIC_PSNR = 1,
     /** Peak Signal to Noise Ratio (Y-channel only) */
     MVT_IMAGE_QUALITY_METRIC_Y_PSNR,
+    /** Bit-exact comparison (number of differing samples) */
+    MVT_IMAGE_QUALITY_METRIC_EXACT,
+    /** Maximum absolute difference */
+    MVT_IMAGE_QUALITY_METRIC_MAX_DIFF,
+    /** Percentage of samples whose absolute difference exceeds tolerance */
+    MVT_IMAGE_QUALITY_METRIC_MISMATCH,
     /** Number of image quality metrics */
     MVT_IMAGE_QUALITY_METRIC_COUNT
 } MvtImageQualityMetric;
@@ -43,16 +49,135 @@ enum {
     MVT_IMAGE_QUALITY_METRIC_FLAG_Y_PSNR        = 1 << 0,
 };
 
+/** Size in samples of the blocks accounted in the block error map */
+#define MVT_IMAGE_COMPARE_BLOCK_SIZE 16
+
+/** Number of bins of the |diff| histograms, i.e. 0..16 plus overflow */
+#define MVT_IMAGE_COMPARE_HIST_BINS 18
+
+/** Statistics of the absolute differences of a component */
+typedef struct {
+    uint64_t            num_samples;    ///< Number of compared samples
+    uint64_t            num_mismatches; ///< Number of samples above tolerance
+    uint32_t            max_diff;       ///< Maximum absolute difference
+    /** Histogram of absolute differences, the last bin counts overflows */
+    uint64_t            hist[MVT_IMAGE_COMPARE_HIST_BINS];
+} MvtImageDiffStats;
+
+/** Side outputs computed along with the image quality metric */
+typedef struct {
+    /**
+     * \brief Image receiving the amplified absolute differences.
+     *
+     * If non-NULL, this shall be a planar image of the same size,
+     * chroma format and bit depth as the compared images.
+     */
+    MvtImage *          diff_image;
+    uint32_t            diff_scale;     ///< Amplification factor for diffs
+    /**
+     * \brief Image receiving the mean squared error of each block.
+     *
+     * If non-NULL, this shall be a planar 16-bit image of the same
+     * chroma format as the compared images, with one sample per block
+     * of \ref MVT_IMAGE_COMPARE_BLOCK_SIZE x \ref
+     * MVT_IMAGE_COMPARE_BLOCK_SIZE samples of each component. The
+     * errors are normalized to an 8-bit range and expressed in 8.8
+     * fixed-point, saturated to 0xffff.
+     */
+    MvtImage *          block_map;
+    /**
+     * \brief Statistics of the absolute differences of each component.
+     *
+     * If non-NULL, this shall be an array of 4 elements, one for each
+     * component. Statistics of the components that are not compared
+     * are cleared. A missing alpha component is compared as if it was
+     * fully opaque.
+     */
+    MvtImageDiffStats * stats;
+    /** Maximum absolute difference tolerated, in sample units */
+    uint32_t            tolerance;
+} MvtImageCompareInfo;
+
+/** Differences found by a bit-exact comparison */
+typedef struct {
+    uint64_t            num_samples;    ///< Number of compared samples
+    uint64_t            num_diffs;      ///< Number of differing samples
+    uint32_t            first_component;///< Component of the first difference
+    uint32_t            first_x;        ///< Column of the first difference
+    uint32_t            first_y;        ///< Row of the first difference
+    VARectangle         bbox;           ///< Bounding box of the differences
+} MvtImageDiffReport;
+
+/** Size of image fingerprints, i.e. width and height of the thumbnail */
+#define MVT_IMAGE_FINGERPRINT_SIZE 16
+
+/**
+ * \brief Image fingerprint.
+ *
+ * A fingerprint is a thumbnail of the first component (luma) of the
+ * image, with each sample holding the average of the corresponding
+ * area, normalized to 8-bit. It is cheap to compute and compare, and
+ * is meant to be used to match frames from two video streams.
+ */
+typedef struct {
+    uint8_t data[MVT_IMAGE_FINGERPRINT_SIZE * MVT_IMAGE_FINGERPRINT_SIZE];
+} MvtImageFingerprint;
+
 /** Compares two images with the supplied quality metric */
 bool
 mvt_image_compare(MvtImage *image, MvtImage *ref_image,
     MvtImageQualityMetric metric, double *value_ptr);
 
+/** Compares two images with the supplied metric, and extra side outputs */
+bool
+mvt_image_compare_full(MvtImage *image, MvtImage *ref_image,
+    MvtImageQualityMetric metric, MvtImageCompareInfo *info,
+    double *value_ptr);
+
 /** Compares two images with the PSNR metric */
 bool
 mvt_image_compare_psnr(MvtImage *image, MvtImage *ref_image, uint32_t flags,
     double *psnr_ptr);
 
+/**
+ * \brief Compares two images for bit-exactness.
+ *
+ * Compares all the samples of \ref image against those of \ref
+ * ref_image and fills in \ref report with the number of differing
+ * samples. The position of the first difference is expressed in
+ * component coordinates, i.e. it takes chroma subsampling into
+ * account, whereas the bounding box of all differences is expressed
+ * in luma (full resolution) coordinates.
+ *
+ * @param[in] image             the image to check
+ * @param[in] ref_image         the reference image
+ * @param[in] flags             the comparison flags (e.g. Y-channel only)
+ * @param[out] report           the differences report
+ * @return \c true on success
+ */
+bool
+mvt_image_compare_exact(MvtImage *image, MvtImage *ref_image, uint32_t flags,
+    MvtImageDiffReport *report);
+
+/** Computes the fingerprint of the supplied image */
+bool
+mvt_image_get_fingerprint(MvtImage *image, MvtImageFingerprint *fp);
+
+/**
+ * \brief Computes the distance between two fingerprints.
+ *
+ * The distance is the sum of absolute differences of the fingerprint
+ * samples, i.e. zero for identical thumbnails and at most 255 times
+ * the number of samples.
+ *
+ * @param[in] fp                the fingerprint to check
+ * @param[in] ref_fp            the reference fingerprint
+ * @return the distance between the fingerprints
+ */
+uint32_t
+mvt_image_fingerprint_distance(const MvtImageFingerprint *fp,
+    const MvtImageFingerprint *ref_fp);
+
 MVT_END_DECLS
 
 #endif /* MVT_IMAGE_COMPARE_H */
@@ -25,18 +25,43 @@
 #include "sysdeps.h"
 #include "mvt_image.h"
 #include "mvt_image_priv.h"
+#include "mvt_image_simd.h"
 #include "mvt_memory.h"
+#include <pthread.h>
+#include <unistd.h>
 #include <libyuv/cpu_id.h>
 #include <libyuv/convert.h>
 #include <libyuv/convert_from.h>
 
 /* Check whether SSE4.1 optimizations could be used */
-#if defined(__x86_64__) || (defined(__i386__) && HAVE_OPT_TARGET)
-# define USE_SSE_COPY 1
+#define USE_SSE_COPY USE_SSE2
+
+/* Check whether AVX2 and AVX-512 optimizations could be used */
+#if USE_SSE_COPY && HAVE_OPT_TARGET && (__GNUC__ >= 5 || defined(__clang__))
+# define USE_AVX_COPY 1
+# include <immintrin.h>
 #else
-# define USE_SSE_COPY 0
+# define USE_AVX_COPY 0
 #endif
 
+/* Size of the bounce buffer used for copies from USWC memory. It holds
+   a block of rows that shall remain in L1 cache between the streaming
+   loads and the copy to the destination */
+#define COPY_CACHE_SIZE (16 * 1024)
+
+/* Alignment of the rows in the bounce buffer, i.e. the size of the
+   widest vector registers */
+#define COPY_CACHE_ALIGN 64
+
+/* Minimum number of pixels for an image to be downloaded by several
+   threads. A single core cannot saturate the memory bandwidth when
+   reading from write-combined memory */
+#define COPY_MT_MIN_PIXELS (1920 * 1088)
+
+/* Maximum number of threads, including the calling thread, used for
+   downloads from USWC memory */
+#define COPY_MAX_THREADS 4
+
 /*****************************************************************************
  * copy.c: Fast I420/NV12 copy
  *****************************************************************************
@@ -61,24 +86,6 @@
  *****************************************************************************/
 
 #if USE_SSE_COPY
-// Initializes copy cache buffer
-static bool
-ensure_copy_cache(MvtImage *image)
-{
-    MvtImagePrivate * const priv = mvt_image_priv_ensure(image);
-
-    if (!priv)
-        return false;
-
-    if (MVT_UNLIKELY(!priv->copy_cache)) {
-        priv->copy_cache_size = MVT_MAX(round_up(image->width, 16), 4096);
-        priv->copy_cache = mem_alloc_aligned(priv->copy_cache_size, 16);
-        if (!priv->copy_cache)
-            return false;
-    }
-    return true;
-}
-
 /* Copy 64 bytes from srcp to dstp loading data with the SSE>=2 instruction
  * load and storing data with the SSE>=2 instruction store.
  */
@@ -179,6 +186,223 @@ Copy2d(uint8_t *dst, size_t dst_pitch,
     }
 }
 
+#if USE_AVX_COPY
+/* Optimized copy from USWC memory (AVX2 version). Streaming loads of
+ * the next 128 bytes are issued before the stores of the current ones.
+ */
+static void
+OPT_TARGET("avx2")
+AVX2_CopyFromUswc(uint8_t *dst, size_t dst_pitch,
+    const uint8_t *src, size_t src_pitch,
+    unsigned width, unsigned height, unsigned cpu)
+{
+    __m256i a0, a1, a2, a3, b0, b1, b2, b3;
+    unsigned x, y;
+
+    _mm_mfence();
+
+    for (y = 0; y < height; y++) {
+        const unsigned unaligned = MVT_MIN((-(uintptr_t)src) & 0x1f, width);
+
+        for (x = 0; x < unaligned; x++)
+            dst[x] = src[x];
+
+        if (x + 128 <= width) {
+            a0 = _mm256_stream_load_si256((__m256i *)&src[x +  0]);
+            a1 = _mm256_stream_load_si256((__m256i *)&src[x + 32]);
+            a2 = _mm256_stream_load_si256((__m256i *)&src[x + 64]);
+            a3 = _mm256_stream_load_si256((__m256i *)&src[x + 96]);
+            for (x += 128; x + 128 <= width; x += 128) {
+                b0 = _mm256_stream_load_si256((__m256i *)&src[x +  0]);
+                b1 = _mm256_stream_load_si256((__m256i *)&src[x + 32]);
+                b2 = _mm256_stream_load_si256((__m256i *)&src[x + 64]);
+                b3 = _mm256_stream_load_si256((__m256i *)&src[x + 96]);
+                _mm256_storeu_si256((__m256i *)&dst[x - 128], a0);
+                _mm256_storeu_si256((__m256i *)&dst[x -  96], a1);
+                _mm256_storeu_si256((__m256i *)&dst[x -  64], a2);
+                _mm256_storeu_si256((__m256i *)&dst[x -  32], a3);
+                a0 = b0, a1 = b1, a2 = b2, a3 = b3;
+            }
+            _mm256_storeu_si256((__m256i *)&dst[x - 128], a0);
+            _mm256_storeu_si256((__m256i *)&dst[x -  96], a1);
+            _mm256_storeu_si256((__m256i *)&dst[x -  64], a2);
+            _mm256_storeu_si256((__m256i *)&dst[x -  32], a3);
+        }
+
+        for (; x < width; x++)
+            dst[x] = src[x];
+
+        src += src_pitch;
+        dst += dst_pitch;
+    }
+}
+
+// Copies from the bounce buffer to the destination (AVX2 version)
+static void
+OPT_TARGET("avx2")
+AVX2_Copy2d(uint8_t *dst, size_t dst_pitch,
+    const uint8_t *src, size_t src_pitch,
+    unsigned width, unsigned height)
+{
+    __m256i a0, a1, a2, a3;
+    unsigned x, y;
+
+    assert(((intptr_t)src & 0x1f) == 0 && (src_pitch & 0x1f) == 0);
+
+    for (y = 0; y < height; y++) {
+        const bool unaligned = ((intptr_t)dst & 0x1f) != 0;
+
+        for (x = 0; x + 127 < width; x += 128) {
+            a0 = _mm256_load_si256((const __m256i *)&src[x +  0]);
+            a1 = _mm256_load_si256((const __m256i *)&src[x + 32]);
+            a2 = _mm256_load_si256((const __m256i *)&src[x + 64]);
+            a3 = _mm256_load_si256((const __m256i *)&src[x + 96]);
+            if (!unaligned) {
+                _mm256_stream_si256((__m256i *)&dst[x +  0], a0);
+                _mm256_stream_si256((__m256i *)&dst[x + 32], a1);
+                _mm256_stream_si256((__m256i *)&dst[x + 64], a2);
+                _mm256_stream_si256((__m256i *)&dst[x + 96], a3);
+            }
+            else {
+                _mm256_storeu_si256((__m256i *)&dst[x +  0], a0);
+                _mm256_storeu_si256((__m256i *)&dst[x + 32], a1);
+                _mm256_storeu_si256((__m256i *)&dst[x + 64], a2);
+                _mm256_storeu_si256((__m256i *)&dst[x + 96], a3);
+            }
+        }
+
+        for (; x < width; x++)
+            dst[x] = src[x];
+
+        src += src_pitch;
+        dst += dst_pitch;
+    }
+    _mm_sfence();
+}
+
+/* Optimized copy from USWC memory (AVX-512 version). Streaming loads of
+ * the next 256 bytes are issued before the stores of the current ones.
+ */
+static void
+OPT_TARGET("avx512f")
+AVX512_CopyFromUswc(uint8_t *dst, size_t dst_pitch,
+    const uint8_t *src, size_t src_pitch,
+    unsigned width, unsigned height, unsigned cpu)
+{
+    __m512i a0, a1, a2, a3, b0, b1, b2, b3;
+    unsigned x, y;
+
+    _mm_mfence();
+
+    for (y = 0; y < height; y++) {
+        const unsigned unaligned = MVT_MIN((-(uintptr_t)src) & 0x3f, width);
+
+        for (x = 0; x < unaligned; x++)
+            dst[x] = src[x];
+
+        if (x + 256 <= width) {
+            a0 = _mm512_stream_load_si512((void *)&src[x +   0]);
+            a1 = _mm512_stream_load_si512((void *)&src[x +  64]);
+            a2 = _mm512_stream_load_si512((void *)&src[x + 128]);
+            a3 = _mm512_stream_load_si512((void *)&src[x + 192]);
+            for (x += 256; x + 256 <= width; x += 256) {
+                b0 = _mm512_stream_load_si512((void *)&src[x +   0]);
+                b1 = _mm512_stream_load_si512((void *)&src[x +  64]);
+                b2 = _mm512_stream_load_si512((void *)&src[x + 128]);
+                b3 = _mm512_stream_load_si512((void *)&src[x + 192]);
+                _mm512_storeu_si512((void *)&dst[x - 256], a0);
+                _mm512_storeu_si512((void *)&dst[x - 192], a1);
+                _mm512_storeu_si512((void *)&dst[x - 128], a2);
+                _mm512_storeu_si512((void *)&dst[x -  64], a3);
+                a0 = b0, a1 = b1, a2 = b2, a3 = b3;
+            }
+            _mm512_storeu_si512((void *)&dst[x - 256], a0);
+            _mm512_storeu_si512((void *)&dst[x - 192], a1);
+            _mm512_storeu_si512((void *)&dst[x - 128], a2);
+            _mm512_storeu_si512((void *)&dst[x -  64], a3);
+        }
+
+        for (; x < width; x++)
+            dst[x] = src[x];
+
+        src += src_pitch;
+        dst += dst_pitch;
+    }
+}
+
+// Copies from the bounce buffer to the destination (AVX-512 version)
+static void
+OPT_TARGET("avx512f")
+AVX512_Copy2d(uint8_t *dst, size_t dst_pitch,
+    const uint8_t *src, size_t src_pitch,
+    unsigned width, unsigned height)
+{
+    __m512i a0, a1, a2, a3;
+    unsigned x, y;
+
+    assert(((intptr_t)src & 0x3f) == 0 && (src_pitch & 0x3f) == 0);
+
+    for (y = 0; y < height; y++) {
+        const bool unaligned = ((intptr_t)dst & 0x3f) != 0;
+
+        for (x = 0; x + 255 < width; x += 256) {
+            a0 = _mm512_load_si512((const void *)&src[x +   0]);
+            a1 = _mm512_load_si512((const void *)&src[x +  64]);
+            a2 = _mm512_load_si512((const void *)&src[x + 128]);
+            a3 = _mm512_load_si512((const void *)&src[x + 192]);
+            if (!unaligned) {
+                _mm512_stream_si512((void *)&dst[x +   0], a0);
+                _mm512_stream_si512((void *)&dst[x +  64], a1);
+                _mm512_stream_si512((void *)&dst[x + 128], a2);
+                _mm512_stream_si512((void *)&dst[x + 192], a3);
+            }
+            else {
+                _mm512_storeu_si512((void *)&dst[x +   0], a0);
+                _mm512_storeu_si512((void *)&dst[x +  64], a1);
+                _mm512_storeu_si512((void *)&dst[x + 128], a2);
+                _mm512_storeu_si512((void *)&dst[x + 192], a3);
+            }
+        }
+
+        for (; x < width; x++)
+            dst[x] = src[x];
+
+        src += src_pitch;
+        dst += dst_pitch;
+    }
+    _mm_sfence();
+}
+#endif
+
+// Copy functions, selected at runtime
+typedef struct {
+    void (*copy_from_uswc)(uint8_t *dst, size_t dst_pitch,
+        const uint8_t *src, size_t src_pitch,
+        unsigned width, unsigned height, unsigned cpu);
+    void (*copy_2d)(uint8_t *dst, size_t dst_pitch,
+        const uint8_t *src, size_t src_pitch,
+        unsigned width, unsigned height);
+} CopyFuncs;
+
+// Determines the best copy functions for the host CPU
+static const CopyFuncs *
+get_copy_funcs(void)
+{
+    static const CopyFuncs sse_copy_funcs = { CopyFromUswc, Copy2d };
+#if USE_AVX_COPY
+    static const CopyFuncs avx2_copy_funcs = {
+        AVX2_CopyFromUswc, AVX2_Copy2d };
+    static const CopyFuncs avx512_copy_funcs = {
+        AVX512_CopyFromUswc, AVX512_Copy2d };
+
+    if (__builtin_cpu_supports("avx512f"))
+        return &avx512_copy_funcs;
+    if (TestCpuFlag(kCpuHasAVX2))
+        return &avx2_copy_funcs;
+#endif
+    return &sse_copy_funcs;
+}
+
 static void
 OPT_TARGET("ssse3")
 SSE_SplitUV(uint8_t *dstu, size_t dstu_pitch,
@@ -269,9 +493,9 @@ static void
 SSE_CopyPlane(uint8_t *dst, size_t dst_pitch,
     const uint8_t *src, size_t src_pitch,
     uint8_t *cache, size_t cache_size,
-    unsigned width, unsigned height, unsigned cpu)
+    unsigned width, unsigned height, unsigned cpu, const CopyFuncs *funcs)
 {
-    const unsigned w16 = round_up(width, 16);
+    const unsigned w16 = round_up(width, COPY_CACHE_ALIGN);
     const unsigned hstep = cache_size / w16;
     unsigned y;
 
@@ -281,12 +505,12 @@ SSE_CopyPlane(uint8_t *dst, size_t dst_pitch,
         const unsigned hblock =  MVT_MIN(hstep, height - y);
 
         /* Copy a bunch of line into our cache */
-        CopyFromUswc(cache, w16,
+        funcs->copy_from_uswc(cache, w16,
                      src, src_pitch,
                      width, hblock, cpu);
 
         /* Copy from our cache to the destination */
-        Copy2d(dst, dst_pitch,
+        funcs->copy_2d(dst, dst_pitch,
                cache, w16,
                width, hblock);
 
@@ -302,9 +526,9 @@ SSE_SplitPlanes(uint8_t *dstu, size_t dstu_pitch,
     uint8_t *dstv, size_t dstv_pitch,
     const uint8_t *src, size_t src_pitch,
     uint8_t *cache, size_t cache_size,
-    unsigned width, unsigned height, unsigned cpu)
+    unsigned width, unsigned height, unsigned cpu, const CopyFuncs *funcs)
 {
-    const unsigned w2_16 = round_up(2*width, 16);
+    const unsigned w2_16 = round_up(2*width, COPY_CACHE_ALIGN);
     const unsigned hstep = cache_size / w2_16;
     unsigned y;
 
@@ -314,7 +538,7 @@ SSE_SplitPlanes(uint8_t *dstu, size_t dstu_pitch,
         const unsigned hblock =  MVT_MIN(hstep, height - y);
 
         /* Copy a bunch of line into our cache */
-        CopyFromUswc(cache, w2_16, src, src_pitch,
+        funcs->copy_from_uswc(cache, w2_16, src, src_pitch,
                      2*width, hblock, cpu);
 
         /* Copy from our cache to the destination */
@@ -329,43 +553,510 @@ SSE_SplitPlanes(uint8_t *dstu, size_t dstu_pitch,
     asm volatile ("mfence");
 }
 
-static bool
-SSE_CopyFromNV12(MvtImage *dst_image, MvtImage *src_image)
+// Copy task, i.e. a plane to download
+typedef struct {
+    uint8_t *           dst;            ///< Destination plane
+    size_t              dst_pitch;      ///< Destination plane pitch
+    uint8_t *           dstv;           ///< Second destination plane (split)
+    size_t              dstv_pitch;     ///< Second destination plane pitch
+    const uint8_t *     src;            ///< Source plane
+    size_t              src_pitch;      ///< Source plane pitch
+    unsigned            width;          ///< Width of the plane, in samples
+    unsigned            height;         ///< Height of the plane, in lines
+    unsigned            bpc;            ///< Bytes per component
+    unsigned            shift;          ///< Right shift count (16-bit only)
+} CopyTask;
+
+// Copy job, i.e. the set of row bands to download for an image
+typedef struct {
+    const CopyTask *    tasks;          ///< Planes to download
+    unsigned            num_tasks;      ///< Number of planes
+    unsigned            num_bands;      ///< Number of row bands per plane
+    unsigned            next_band;      ///< Next row band to process
+    size_t              cache_size;     ///< Minimum bounce buffer size
+    unsigned            cpu;            ///< CPU flags
+    const CopyFuncs *   funcs;          ///< Copy functions
+    bool                from_uswc;      ///< Flag: source is USWC memory
+} CopyJob;
+
+/* Loads 16 bytes. Streaming loads are used to read from USWC memory, in
+   which case the address shall be 16-byte aligned */
+static inline __m128i
+MVT_ALWAYS_INLINE
+OPT_TARGET("sse2")
+load_si128(const uint16_t *p, bool stream)
 {
-    MvtImagePrivate * const priv = mvt_image_priv_ensure(dst_image);
-    unsigned cpu = TestCpuFlag(kCpuHasSSSE3|kCpuHasSSE41);
+    __m128i v;
 
-    if (!priv || !ensure_copy_cache(dst_image))
+    if (!stream)
+        return _mm_loadu_si128((const __m128i *)p);
+    asm volatile ("movntdqa %1, %0" : "=x" (v) : "m" (*(const __m128i *)p));
+    return v;
+}
+
+// Copies a row of 16-bit samples, shifted right by the supplied count
+static inline void
+MVT_ALWAYS_INLINE
+OPT_TARGET("sse2")
+copy_row16_sse2(uint16_t *dst, const uint16_t *src, unsigned width,
+    __m128i count, bool stream)
+{
+    __m128i v[4];
+    unsigned x, i;
+
+    for (x = 0; x + 32 <= width; x += 32) {
+        for (i = 0; i < 4; i++)
+            v[i] = load_si128(&src[x + 8*i], stream);
+        for (i = 0; i < 4; i++)
+            _mm_storeu_si128((__m128i *)&dst[x + 8*i],
+                _mm_srl_epi16(v[i], count));
+    }
+    for (; x + 8 <= width; x += 8)
+        _mm_storeu_si128((__m128i *)&dst[x],
+            _mm_srl_epi16(load_si128(&src[x], stream), count));
+    for (; x < width; x++)
+        dst[x] = src[x] >> _mm_cvtsi128_si32(count);
+}
+
+/* Deinterleaves a row of 16-bit UV samples, shifted right by the supplied
+   count. Each vector of 4 UV pairs is shuffled to U0..U3 V0..V3 */
+static inline void
+MVT_ALWAYS_INLINE
+OPT_TARGET("sse2")
+split_row16_sse2(uint16_t *dstu, uint16_t *dstv, const uint16_t *src,
+    unsigned width, __m128i count, bool stream)
+{
+    __m128i v[4];
+    unsigned x, i;
+
+    for (x = 0; x + 16 <= width; x += 16) {
+        for (i = 0; i < 4; i++)
+            v[i] = load_si128(&src[2*x + 8*i], stream);
+        for (i = 0; i < 4; i++) {
+            v[i] = _mm_srl_epi16(v[i], count);
+            v[i] = _mm_shufflelo_epi16(v[i], _MM_SHUFFLE(3,1,2,0));
+            v[i] = _mm_shufflehi_epi16(v[i], _MM_SHUFFLE(3,1,2,0));
+            v[i] = _mm_shuffle_epi32(v[i], _MM_SHUFFLE(3,1,2,0));
+        }
+        for (i = 0; i < 2; i++) {
+            _mm_storeu_si128((__m128i *)&dstu[x + 8*i],
+                _mm_unpacklo_epi64(v[2*i], v[2*i+1]));
+            _mm_storeu_si128((__m128i *)&dstv[x + 8*i],
+                _mm_unpackhi_epi64(v[2*i], v[2*i+1]));
+        }
+    }
+    for (; x < width; x++) {
+        dstu[x] = src[2*x+0] >> _mm_cvtsi128_si32(count);
+        dstv[x] = src[2*x+1] >> _mm_cvtsi128_si32(count);
+    }
+}
+
+// Copies a band of rows of 16-bit samples, deinterleaving them if needed
+static inline void
+MVT_ALWAYS_INLINE
+OPT_TARGET("sse2")
+copy_band16_sse2(const CopyTask *task, unsigned y, unsigned height,
+    bool stream)
+{
+    const __m128i count = _mm_cvtsi32_si128(task->shift);
+    const uint8_t *src = task->src + y * task->src_pitch;
+    uint8_t *dst = task->dst + y * task->dst_pitch;
+    uint8_t *dstv = task->dstv ? task->dstv + y * task->dstv_pitch : NULL;
+    unsigned i;
+
+    for (i = 0; i < height; i++) {
+        if (task->dstv) {
+            split_row16_sse2((uint16_t *)dst, (uint16_t *)dstv,
+                (const uint16_t *)src, task->width, count, stream);
+            dstv += task->dstv_pitch;
+        }
+        else
+            copy_row16_sse2((uint16_t *)dst, (const uint16_t *)src,
+                task->width, count, stream);
+        src += task->src_pitch;
+        dst += task->dst_pitch;
+    }
+}
+
+static void
+OPT_TARGET("sse2")
+SSE_CopyBand16(const CopyTask *task, unsigned y, unsigned height)
+{
+    copy_band16_sse2(task, y, height, false);
+}
+
+static void
+OPT_TARGET("sse2")
+SSE_CopyBand16FromUswc(const CopyTask *task, unsigned y, unsigned height)
+{
+    asm volatile ("mfence");
+    copy_band16_sse2(task, y, height, true);
+    asm volatile ("mfence");
+}
+
+// Pool of worker threads for downloads of large images
+typedef struct {
+    pthread_mutex_t     lock;           ///< Lock serializing jobs
+    pthread_mutex_t     job_lock;       ///< Lock for the fields below
+    pthread_cond_t      job_cond;       ///< Signaled when a job is posted
+    pthread_cond_t      done_cond;      ///< Signaled when a worker is done
+    CopyJob *           job;            ///< Current job
+    uint32_t            job_id;         ///< Current job identifier
+    unsigned            num_active;     ///< Number of workers on the job
+    unsigned            num_threads;    ///< Number of worker threads
+} CopyPool;
+
+static CopyPool g_copy_pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .job_lock = PTHREAD_MUTEX_INITIALIZER,
+    .job_cond = PTHREAD_COND_INITIALIZER,
+    .done_cond = PTHREAD_COND_INITIALIZER,
+};
+static pthread_once_t g_copy_pool_once = PTHREAD_ONCE_INIT;
+
+// Claims the next row band of the job, or returns false if there is none
+static bool
+copy_job_next_band(CopyPool *pool, CopyJob *job, const CopyTask **task_ptr,
+    unsigned *y_ptr, unsigned *height_ptr)
+{
+    const CopyTask *task;
+    unsigned n, y0, y1;
+
+    pthread_mutex_lock(&pool->job_lock);
+    n = job->next_band;
+    if (n < job->num_tasks * job->num_bands)
+        job->next_band++;
+    pthread_mutex_unlock(&pool->job_lock);
+    if (n >= job->num_tasks * job->num_bands)
         return false;
 
-    SSE_CopyPlane(dst_image->pixels[0], dst_image->pitches[0],
-        src_image->pixels[0], src_image->pitches[0],
-        priv->copy_cache, priv->copy_cache_size,
-        dst_image->width, dst_image->height, cpu);
-    SSE_SplitPlanes(dst_image->pixels[1], dst_image->pitches[1],
-        dst_image->pixels[2], dst_image->pitches[2],
-        src_image->pixels[1], src_image->pitches[1],
-        priv->copy_cache, priv->copy_cache_size,
-        (dst_image->width + 1)/2, (dst_image->height + 1)/2, cpu);
+    task = &job->tasks[n / job->num_bands];
+    n %= job->num_bands;
+    y0 = (uint64_t)task->height * n / job->num_bands;
+    y1 = (uint64_t)task->height * (n + 1) / job->num_bands;
+
+    *task_ptr = task;
+    *y_ptr = y0;
+    *height_ptr = y1 - y0;
+    return true;
+}
+
+// Processes row bands of the job until there is none left
+static void
+copy_job_run(CopyPool *pool, CopyJob *job, uint8_t *cache, size_t cache_size)
+{
+    const CopyTask *task;
+    unsigned y, height;
+
+    while (copy_job_next_band(pool, job, &task, &y, &height)) {
+        if (height == 0)
+            continue;
+        if (task->bpc == 2) {
+            // Streaming loads require SSE4.1 and aligned rows
+            if (job->from_uswc && (job->cpu & kCpuHasSSE41) &&
+                ((uintptr_t)task->src & 0x0f) == 0 &&
+                (task->src_pitch & 0x0f) == 0)
+                SSE_CopyBand16FromUswc(task, y, height);
+            else
+                SSE_CopyBand16(task, y, height);
+        }
+        else if (!task->dstv)
+            SSE_CopyPlane(task->dst + y * task->dst_pitch, task->dst_pitch,
+                task->src + y * task->src_pitch, task->src_pitch,
+                cache, cache_size, task->width, height, job->cpu, job->funcs);
+        else
+            SSE_SplitPlanes(task->dst + y * task->dst_pitch, task->dst_pitch,
+                task->dstv + y * task->dstv_pitch, task->dstv_pitch,
+                task->src + y * task->src_pitch, task->src_pitch,
+                cache, cache_size, task->width, height, job->cpu, job->funcs);
+    }
     asm volatile ("emms");
+}
+
+// Worker thread: processes jobs with its own bounce buffer
+static void *
+copy_pool_thread(void *arg)
+{
+    CopyPool * const pool = arg;
+    uint8_t *cache = NULL;
+    size_t cache_size = 0;
+    uint32_t job_id = 0;
+    CopyJob *job;
+
+    pthread_mutex_lock(&pool->job_lock);
+    for (;;) {
+        while (pool->job_id == job_id)
+            pthread_cond_wait(&pool->job_cond, &pool->job_lock);
+        job_id = pool->job_id;
+        job = pool->job;
+        pthread_mutex_unlock(&pool->job_lock);
+
+        if (cache_size < job->cache_size) {
+            mem_freep(&cache);
+            cache = mem_alloc_aligned(job->cache_size, COPY_CACHE_ALIGN);
+            cache_size = cache ? job->cache_size : 0;
+        }
+        if (cache)
+            copy_job_run(pool, job, cache, cache_size);
+
+        pthread_mutex_lock(&pool->job_lock);
+        if (--pool->num_active == 0)
+            pthread_cond_signal(&pool->done_cond);
+    }
+    return NULL;
+}
+
+// Initializes the pool of worker threads, once
+static void
+copy_pool_init(void)
+{
+    CopyPool * const pool = &g_copy_pool;
+    pthread_attr_t attr;
+    pthread_t thread;
+    long num_cpus;
+    unsigned i, num_threads;
+
+    num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_cpus <= 1)
+        return;
+    num_threads = MVT_MIN(num_cpus, COPY_MAX_THREADS) - 1;
+
+    if (pthread_attr_init(&attr) != 0)
+        goto error_init_attr;
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    // Workers that failed to start are simply not accounted for
+    for (i = 0; i < num_threads; i++) {
+        if (pthread_create(&thread, &attr, copy_pool_thread, pool) != 0)
+            break;
+        pool->num_threads++;
+    }
+    pthread_attr_destroy(&attr);
+    return;
+
+    /* ERRORS */
+error_init_attr:
+    mvt_warning("image: failed to create worker threads for USWC copies");
+}
+
+// Runs the copy job, splitting planes into row bands for large images
+static bool
+copy_job_execute(MvtImage *dst_image, CopyJob *job)
+{
+    CopyPool * const pool = &g_copy_pool;
+    const bool use_threads =
+        dst_image->width * dst_image->height >= COPY_MT_MIN_PIXELS;
+    const uint32_t cache_size = MVT_MAX(round_up(dst_image->width,
+        COPY_CACHE_ALIGN), COPY_CACHE_SIZE);
+    const MemScratchMark mark = mem_scratch_mark();
+    uint8_t *cache;
+
+    cache = mem_scratch_alloc(cache_size, COPY_CACHE_ALIGN);
+    if (!cache)
+        return false;
+
+    job->next_band = 0;
+    job->cache_size = cache_size;
+    job->cpu = TestCpuFlag(kCpuHasSSSE3|kCpuHasSSE41);
+    job->funcs = get_copy_funcs();
+
+    if (use_threads)
+        pthread_once(&g_copy_pool_once, copy_pool_init);
+
+    if (!use_threads || pool->num_threads == 0) {
+        job->num_bands = 1;
+        copy_job_run(pool, job, cache, cache_size);
+        mem_scratch_release(&mark);
+        return true;
+    }
+
+    // The calling thread processes row bands too, with its own cache
+    job->num_bands = pool->num_threads + 1;
+
+    pthread_mutex_lock(&pool->lock);
+    pthread_mutex_lock(&pool->job_lock);
+    pool->job = job;
+    pool->job_id++;
+    pool->num_active = pool->num_threads;
+    pthread_cond_broadcast(&pool->job_cond);
+    pthread_mutex_unlock(&pool->job_lock);
+
+    copy_job_run(pool, job, cache, cache_size);
+
+    pthread_mutex_lock(&pool->job_lock);
+    while (pool->num_active > 0)
+        pthread_cond_wait(&pool->done_cond, &pool->job_lock);
+    pool->job = NULL;
+    pthread_mutex_unlock(&pool->job_lock);
+    pthread_mutex_unlock(&pool->lock);
+    mem_scratch_release(&mark);
     return true;
 }
 
 static bool
-SSE_CopyFromI420(MvtImage *dst_image, MvtImage *src_image)
+SSE_CopyFromNV12(MvtImage *dst_image, MvtImage *src_image)
 {
-    MvtImagePrivate * const priv = mvt_image_priv_ensure(dst_image);
-    unsigned n, cpu = TestCpuFlag(kCpuHasSSSE3|kCpuHasSSE41);
+    CopyTask tasks[2];
+    CopyJob job;
+
+    memset(tasks, 0, sizeof(tasks));
+    tasks[0].dst = dst_image->pixels[0];
+    tasks[0].dst_pitch = dst_image->pitches[0];
+    tasks[0].src = src_image->pixels[0];
+    tasks[0].src_pitch = src_image->pitches[0];
+    tasks[0].width = dst_image->width;
+    tasks[0].height = dst_image->height;
+    tasks[0].bpc = 1;
+
+    tasks[1].dst = dst_image->pixels[1];
+    tasks[1].dst_pitch = dst_image->pitches[1];
+    tasks[1].dstv = dst_image->pixels[2];
+    tasks[1].dstv_pitch = dst_image->pitches[2];
+    tasks[1].src = src_image->pixels[1];
+    tasks[1].src_pitch = src_image->pitches[1];
+    tasks[1].width = (dst_image->width + 1) / 2;
+    tasks[1].height = (dst_image->height + 1) / 2;
+    tasks[1].bpc = 1;
+
+    job.tasks = tasks;
+    job.num_tasks = 2;
+    job.from_uswc = true;
+    return copy_job_execute(dst_image, &job);
+}
 
-    if (!priv || !ensure_copy_cache(dst_image))
-        return false;
+static bool
+SSE_CopyFromI420(MvtImage *dst_image, MvtImage *src_image)
+{
+    CopyTask tasks[3];
+    CopyJob job;
+    unsigned n;
 
+    memset(tasks, 0, sizeof(tasks));
     for (n = 0; n < 3; n++) {
         const unsigned d = n > 0 ? 2 : 1;
-        SSE_CopyPlane(dst_image->pixels[n], dst_image->pitches[n],
-            src_image->pixels[n], src_image->pitches[n],
-            priv->copy_cache, priv->copy_cache_size,
-            (dst_image->width + d - 1)/d, (dst_image->height + d - 1)/d, cpu);
+        tasks[n].dst = dst_image->pixels[n];
+        tasks[n].dst_pitch = dst_image->pitches[n];
+        tasks[n].src = src_image->pixels[n];
+        tasks[n].src_pitch = src_image->pitches[n];
+        tasks[n].width = (dst_image->width + d - 1) / d;
+        tasks[n].height = (dst_image->height + d - 1) / d;
+        tasks[n].bpc = 1;
+    }
+
+    job.tasks = tasks;
+    job.num_tasks = 3;
+    job.from_uswc = true;
+    return copy_job_execute(dst_image, &job);
+}
+
+/* Converts P010/P016 to I420P10/I420P16, i.e. shifts MSB-aligned samples
+   down to their bit depth and deinterleaves the UV plane, in one pass */
+static bool
+SSE_CopyFromP01x(MvtImage *dst_image, MvtImage *src_image, unsigned shift,
+    bool from_uswc)
+{
+    CopyTask tasks[2];
+    CopyJob job;
+
+    memset(tasks, 0, sizeof(tasks));
+    tasks[0].dst = dst_image->pixels[0];
+    tasks[0].dst_pitch = dst_image->pitches[0];
+    tasks[0].src = src_image->pixels[0];
+    tasks[0].src_pitch = src_image->pitches[0];
+    tasks[0].width = dst_image->width;
+    tasks[0].height = dst_image->height;
+    tasks[0].bpc = 2;
+    tasks[0].shift = shift;
+
+    tasks[1].dst = dst_image->pixels[1];
+    tasks[1].dst_pitch = dst_image->pitches[1];
+    tasks[1].dstv = dst_image->pixels[2];
+    tasks[1].dstv_pitch = dst_image->pitches[2];
+    tasks[1].src = src_image->pixels[1];
+    tasks[1].src_pitch = src_image->pitches[1];
+    tasks[1].width = (dst_image->width + 1) / 2;
+    tasks[1].height = (dst_image->height + 1) / 2;
+    tasks[1].bpc = 2;
+    tasks[1].shift = shift;
+
+    job.tasks = tasks;
+    job.num_tasks = 2;
+    job.from_uswc = from_uswc;
+    return copy_job_execute(dst_image, &job);
+}
+
+/* Hashes a plane, block by block, while the rows are in the bounce buffer.
+   With split set, the plane holds interleaved UV samples, and only the
+   samples at the supplied offset are hashed */
+static void
+SSE_HashPlane(MvtHash *hash, const uint8_t *src, size_t src_pitch,
+    uint8_t *cache, size_t cache_size, uint8_t *line, unsigned width,
+    unsigned height, bool split, unsigned offset, unsigned cpu,
+    const CopyFuncs *funcs)
+{
+    const unsigned w16 = round_up(split ? 2*width : width, COPY_CACHE_ALIGN);
+    const unsigned hstep = cache_size / w16;
+    unsigned y, i;
+
+    assert(hstep > 0);
+
+    for (y = 0; y < height; y += hstep) {
+        const unsigned hblock = MVT_MIN(hstep, height - y);
+
+        funcs->copy_from_uswc(cache, w16, src, src_pitch,
+            split ? 2*width : width, hblock, cpu);
+
+        for (i = 0; i < hblock; i++) {
+            const uint8_t * const row = cache + i * w16;
+            if (!split)
+                mvt_hash_update(hash, row, width);
+            else {
+                SSE_SplitUV(line, 0, line + width, 0, row, w16, width, 1, cpu);
+                mvt_hash_update(hash, line + offset * width, width);
+            }
+        }
+        src += src_pitch * hblock;
+    }
+    asm volatile ("mfence");
+}
+
+// Computes the checksum of an NV12 or I420 image in USWC memory
+bool
+mvt_image_hash_uswc(MvtImage *image, MvtHash *hash)
+{
+    uint8_t cache[COPY_CACHE_SIZE] __attribute__((aligned(COPY_CACHE_ALIGN)));
+    uint8_t line[COPY_CACHE_SIZE / 2];
+    const CopyFuncs * const funcs = get_copy_funcs();
+    const unsigned cpu = TestCpuFlag(kCpuHasSSSE3|kCpuHasSSE41);
+    const unsigned cw = (image->width + 1) / 2, ch = (image->height + 1) / 2;
+    unsigned n;
+
+    // Rows shall fit into the bounce buffer, with chroma split in two lines
+    if (round_up(image->width, COPY_CACHE_ALIGN) > sizeof(cache) ||
+        2 * cw > sizeof(line))
+        return false;
+
+    switch (image->format) {
+    case VIDEO_FORMAT_NV12:
+        mvt_hash_init(hash);
+        SSE_HashPlane(hash, image->pixels[0], image->pitches[0],
+            cache, sizeof(cache), line, image->width, image->height,
+            false, 0, cpu, funcs);
+        for (n = 0; n < 2; n++)
+            SSE_HashPlane(hash, image->pixels[1], image->pitches[1],
+                cache, sizeof(cache), line, cw, ch, true, n, cpu, funcs);
+        mvt_hash_finalize(hash);
+        break;
+    case VIDEO_FORMAT_I420:
+        mvt_hash_init(hash);
+        for (n = 0; n < 3; n++)
+            SSE_HashPlane(hash, image->pixels[n], image->pitches[n],
+                cache, sizeof(cache), line, n > 0 ? cw : image->width,
+                n > 0 ? ch : image->height, false, 0, cpu, funcs);
+        mvt_hash_finalize(hash);
+        break;
+    default:
+        return false;
     }
     asm volatile ("emms");
     return true;
@@ -373,6 +1064,482 @@ SSE_CopyFromI420(MvtImage *dst_image, MvtImage *src_image)
 #undef COPY64
 #endif
 
+#if !USE_SSE_COPY
+// Computes the checksum of an NV12 or I420 image in USWC memory
+bool
+mvt_image_hash_uswc(MvtImage *image, MvtHash *hash)
+{
+    return false;
+}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- Generic conversions                                                --- */
+/* -------------------------------------------------------------------------- */
+
+// Conversion parameters of a component
+typedef struct {
+    unsigned            src_offset;     ///< Source byte offset in a pixel
+    unsigned            src_shift;      ///< Shift count to the source bits
+    unsigned            dst_offset;     ///< Destination byte offset in a pixel
+    unsigned            dst_shift;      ///< Shift count to the destination bits
+    unsigned            mask;           ///< Mask of the sample bits
+    unsigned            up_shift;       ///< Shift count to a higher depth
+    unsigned            down_shift;     ///< Shift count to a lower depth
+    unsigned            rounding;       ///< Rounding bias for down_shift
+    unsigned            max_value;      ///< Max value at the destination depth
+} ConvertParams;
+
+#if USE_SSE_COPY
+# define CONVERT_ROW_TARGET OPT_TARGET("sse2")
+#else
+# define CONVERT_ROW_TARGET
+#endif
+
+/* Converts a row of samples of a component. The src and dst pointers
+   designate the start of the first pixel unit of the row */
+typedef void (*ConvertRowFunc)(uint8_t *dst, const uint8_t *src,
+    unsigned width, const ConvertParams *params);
+
+#if USE_SSE_COPY
+/* Merges the v samples into the 16 bytes at p, keeping the bytes that
+   are not covered by mask, i.e. the samples of other components */
+static inline void
+MVT_ALWAYS_INLINE
+OPT_TARGET("sse2")
+store_merge(uint8_t *p, __m128i v, __m128i mask)
+{
+    const __m128i d = _mm_loadu_si128((const __m128i *)p);
+
+    _mm_storeu_si128((__m128i *)p,
+        _mm_or_si128(_mm_andnot_si128(mask, d), _mm_and_si128(mask, v)));
+}
+
+/* Stores 16 8-bit samples spaced by stride bytes, and located at offset
+   within each pixel unit */
+static inline void
+MVT_ALWAYS_INLINE
+OPT_TARGET("sse2")
+store_samples8(uint8_t *p, unsigned stride, unsigned offset, __m128i v)
+{
+    const __m128i shift = _mm_cvtsi32_si128(8 * offset);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i v0, v1, m;
+
+    switch (stride) {
+    case 1:
+        _mm_storeu_si128((__m128i *)p, v);
+        break;
+    case 2:
+        m = _mm_sll_epi16(_mm_set1_epi16(0xff), shift);
+        store_merge(p, _mm_sll_epi16(_mm_unpacklo_epi8(v, zero), shift), m);
+        store_merge(p + 16,
+            _mm_sll_epi16(_mm_unpackhi_epi8(v, zero), shift), m);
+        break;
+    case 4:
+        m = _mm_sll_epi32(_mm_set1_epi32(0xff), shift);
+        v0 = _mm_unpacklo_epi8(v, zero);
+        v1 = _mm_unpackhi_epi8(v, zero);
+        store_merge(p, _mm_sll_epi32(_mm_unpacklo_epi16(v0, zero), shift), m);
+        store_merge(p + 16,
+            _mm_sll_epi32(_mm_unpackhi_epi16(v0, zero), shift), m);
+        store_merge(p + 32,
+            _mm_sll_epi32(_mm_unpacklo_epi16(v1, zero), shift), m);
+        store_merge(p + 48,
+            _mm_sll_epi32(_mm_unpackhi_epi16(v1, zero), shift), m);
+        break;
+    }
+}
+
+/* Loads 8 16-bit samples spaced by stride bytes, and located at offset
+   within each pixel unit */
+static inline __m128i
+MVT_ALWAYS_INLINE
+OPT_TARGET("sse2")
+load_samples16(const uint8_t *p, unsigned stride, unsigned offset)
+{
+    const __m128i shift = _mm_cvtsi32_si128(8 * offset);
+    __m128i v0, v1;
+
+    if (stride != 4)
+        return _mm_loadu_si128((const __m128i *)p);
+
+    v0 = _mm_srl_epi32(_mm_loadu_si128((const __m128i *)p), shift);
+    v1 = _mm_srl_epi32(_mm_loadu_si128((const __m128i *)(p + 16)), shift);
+    v0 = _mm_shufflelo_epi16(v0, _MM_SHUFFLE(3,1,2,0));
+    v0 = _mm_shufflehi_epi16(v0, _MM_SHUFFLE(3,1,2,0));
+    v0 = _mm_shuffle_epi32(v0, _MM_SHUFFLE(3,1,2,0));
+    v1 = _mm_shufflelo_epi16(v1, _MM_SHUFFLE(3,1,2,0));
+    v1 = _mm_shufflehi_epi16(v1, _MM_SHUFFLE(3,1,2,0));
+    v1 = _mm_shuffle_epi32(v1, _MM_SHUFFLE(3,1,2,0));
+    return _mm_unpacklo_epi64(v0, v1);
+}
+
+/* Stores 8 16-bit samples spaced by stride bytes, and located at offset
+   within each pixel unit */
+static inline void
+MVT_ALWAYS_INLINE
+OPT_TARGET("sse2")
+store_samples16(uint8_t *p, unsigned stride, unsigned offset, __m128i v)
+{
+    const __m128i shift = _mm_cvtsi32_si128(8 * offset);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i m;
+
+    if (stride != 4) {
+        _mm_storeu_si128((__m128i *)p, v);
+        return;
+    }
+
+    m = _mm_sll_epi32(_mm_set1_epi32(0xffff), shift);
+    store_merge(p, _mm_sll_epi32(_mm_unpacklo_epi16(v, zero), shift), m);
+    store_merge(p + 16, _mm_sll_epi32(_mm_unpackhi_epi16(v, zero), shift), m);
+}
+
+/* Changes the bit depth of 8 16-bit samples: shifts up, or rounds and
+   shifts down, then clips to the max value of the destination depth */
+static inline __m128i
+MVT_ALWAYS_INLINE
+OPT_TARGET("sse2")
+convert_depth16(__m128i v, __m128i up_shift, __m128i down_shift,
+    __m128i rounding, __m128i max_value)
+{
+    v = _mm_adds_epu16(_mm_sll_epi16(v, up_shift), rounding);
+    v = _mm_srl_epi16(v, down_shift);
+    return _mm_sub_epi16(v, _mm_subs_epu16(v, max_value));
+}
+#endif
+
+// Changes the bit depth of a sample
+static inline unsigned
+MVT_ALWAYS_INLINE
+convert_depth(unsigned v, const ConvertParams *params)
+{
+    v = ((v << params->up_shift) + params->rounding) >> params->down_shift;
+    return MVT_MIN(v, params->max_value);
+}
+
+// Converts a row of 8-bit samples
+static inline void
+MVT_ALWAYS_INLINE
+CONVERT_ROW_TARGET
+convert_row8(uint8_t *dst, unsigned dst_stride, const uint8_t *src,
+    unsigned src_stride, unsigned width, const ConvertParams *params)
+{
+    unsigned x = 0;
+
+#if USE_SSE_COPY
+    for (; x + 16 <= width; x += 16)
+        store_samples8(&dst[x * dst_stride], dst_stride, params->dst_offset,
+            load_samples8(&src[x * src_stride], src_stride,
+                params->src_offset));
+#endif
+    for (; x < width; x++)
+        dst[x * dst_stride + params->dst_offset] =
+            src[x * src_stride + params->src_offset];
+}
+
+// Converts a row of 16-bit samples
+static inline void
+MVT_ALWAYS_INLINE
+CONVERT_ROW_TARGET
+convert_row16(uint8_t *dst, unsigned dst_stride, const uint8_t *src,
+    unsigned src_stride, unsigned width, const ConvertParams *params)
+{
+    unsigned x = 0;
+
+#if USE_SSE_COPY
+    const __m128i src_shift = _mm_cvtsi32_si128(params->src_shift);
+    const __m128i dst_shift = _mm_cvtsi32_si128(params->dst_shift);
+    const __m128i mask = _mm_set1_epi16(params->mask);
+    const __m128i up_shift = _mm_cvtsi32_si128(params->up_shift);
+    const __m128i down_shift = _mm_cvtsi32_si128(params->down_shift);
+    const __m128i rounding = _mm_set1_epi16(params->rounding);
+    const __m128i max_value = _mm_set1_epi16(params->max_value);
+
+    for (; x + 8 <= width; x += 8) {
+        __m128i v = load_samples16(&src[x * src_stride], src_stride,
+            params->src_offset);
+        v = _mm_and_si128(_mm_srl_epi16(v, src_shift), mask);
+        v = convert_depth16(v, up_shift, down_shift, rounding, max_value);
+        store_samples16(&dst[x * dst_stride], dst_stride, params->dst_offset,
+            _mm_sll_epi16(v, dst_shift));
+    }
+#endif
+    for (; x < width; x++) {
+        const uint16_t v = *(const uint16_t *)
+            &src[x * src_stride + params->src_offset];
+        *(uint16_t *)&dst[x * dst_stride + params->dst_offset] =
+            convert_depth((v >> params->src_shift) & params->mask, params) <<
+            params->dst_shift;
+    }
+}
+
+// Converts a row of 8-bit samples to 16-bit samples
+static inline void
+MVT_ALWAYS_INLINE
+CONVERT_ROW_TARGET
+convert_row8to16(uint8_t *dst, unsigned dst_stride, const uint8_t *src,
+    unsigned src_stride, unsigned width, const ConvertParams *params)
+{
+    unsigned x = 0;
+
+#if USE_SSE_COPY
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i dst_shift = _mm_cvtsi32_si128(params->dst_shift);
+    const __m128i up_shift = _mm_cvtsi32_si128(params->up_shift);
+
+    for (; x + 16 <= width; x += 16) {
+        const __m128i v = load_samples8(&src[x * src_stride], src_stride,
+            params->src_offset);
+        const __m128i v0 = _mm_sll_epi16(_mm_unpacklo_epi8(v, zero), up_shift);
+        const __m128i v1 = _mm_sll_epi16(_mm_unpackhi_epi8(v, zero), up_shift);
+        store_samples16(&dst[x * dst_stride], dst_stride, params->dst_offset,
+            _mm_sll_epi16(v0, dst_shift));
+        store_samples16(&dst[(x + 8) * dst_stride], dst_stride,
+            params->dst_offset, _mm_sll_epi16(v1, dst_shift));
+    }
+#endif
+    for (; x < width; x++)
+        *(uint16_t *)&dst[x * dst_stride + params->dst_offset] =
+            convert_depth(src[x * src_stride + params->src_offset], params) <<
+            params->dst_shift;
+}
+
+// Converts a row of 16-bit samples to 8-bit samples
+static inline void
+MVT_ALWAYS_INLINE
+CONVERT_ROW_TARGET
+convert_row16to8(uint8_t *dst, unsigned dst_stride, const uint8_t *src,
+    unsigned src_stride, unsigned width, const ConvertParams *params)
+{
+    unsigned x = 0;
+
+#if USE_SSE_COPY
+    const __m128i src_shift = _mm_cvtsi32_si128(params->src_shift);
+    const __m128i mask = _mm_set1_epi16(params->mask);
+    const __m128i up_shift = _mm_cvtsi32_si128(params->up_shift);
+    const __m128i down_shift = _mm_cvtsi32_si128(params->down_shift);
+    const __m128i rounding = _mm_set1_epi16(params->rounding);
+    const __m128i max_value = _mm_set1_epi16(params->max_value);
+
+    for (; x + 16 <= width; x += 16) {
+        __m128i v0 = load_samples16(&src[x * src_stride], src_stride,
+            params->src_offset);
+        __m128i v1 = load_samples16(&src[(x + 8) * src_stride], src_stride,
+            params->src_offset);
+        v0 = _mm_and_si128(_mm_srl_epi16(v0, src_shift), mask);
+        v1 = _mm_and_si128(_mm_srl_epi16(v1, src_shift), mask);
+        v0 = convert_depth16(v0, up_shift, down_shift, rounding, max_value);
+        v1 = convert_depth16(v1, up_shift, down_shift, rounding, max_value);
+        store_samples8(&dst[x * dst_stride], dst_stride, params->dst_offset,
+            _mm_packus_epi16(v0, v1));
+    }
+#endif
+    for (; x < width; x++) {
+        const uint16_t v = *(const uint16_t *)
+            &src[x * src_stride + params->src_offset];
+        dst[x * dst_stride + params->dst_offset] =
+            convert_depth((v >> params->src_shift) & params->mask, params);
+    }
+}
+
+#define DEFINE_CONVERT_ROW(KERNEL, SRC_STRIDE, DST_STRIDE)              \
+static void                                                             \
+CONVERT_ROW_TARGET                                                      \
+convert_row##KERNEL##_##SRC_STRIDE##_##DST_STRIDE(uint8_t *dst,        \
+    const uint8_t *src, unsigned width, const ConvertParams *params)    \
+{                                                                       \
+    MVT_GEN_CONCAT(convert_row,KERNEL)(dst, DST_STRIDE, src, SRC_STRIDE,\
+        width, params);                                                 \
+}
+
+DEFINE_CONVERT_ROW(8, 1, 1)
+DEFINE_CONVERT_ROW(8, 1, 2)
+DEFINE_CONVERT_ROW(8, 1, 4)
+DEFINE_CONVERT_ROW(8, 2, 1)
+DEFINE_CONVERT_ROW(8, 2, 2)
+DEFINE_CONVERT_ROW(8, 2, 4)
+DEFINE_CONVERT_ROW(8, 4, 1)
+DEFINE_CONVERT_ROW(8, 4, 2)
+DEFINE_CONVERT_ROW(8, 4, 4)
+DEFINE_CONVERT_ROW(16, 2, 2)
+DEFINE_CONVERT_ROW(16, 2, 4)
+DEFINE_CONVERT_ROW(16, 4, 2)
+DEFINE_CONVERT_ROW(16, 4, 4)
+DEFINE_CONVERT_ROW(8to16, 1, 2)
+DEFINE_CONVERT_ROW(8to16, 1, 4)
+DEFINE_CONVERT_ROW(8to16, 2, 2)
+DEFINE_CONVERT_ROW(8to16, 2, 4)
+DEFINE_CONVERT_ROW(8to16, 4, 2)
+DEFINE_CONVERT_ROW(8to16, 4, 4)
+DEFINE_CONVERT_ROW(16to8, 2, 1)
+DEFINE_CONVERT_ROW(16to8, 2, 2)
+DEFINE_CONVERT_ROW(16to8, 2, 4)
+DEFINE_CONVERT_ROW(16to8, 4, 1)
+DEFINE_CONVERT_ROW(16to8, 4, 2)
+DEFINE_CONVERT_ROW(16to8, 4, 4)
+
+#undef DEFINE_CONVERT_ROW
+#undef CONVERT_ROW_TARGET
+
+// Determines the index of the pixel stride, in samples
+static int
+get_stride_index(unsigned stride)
+{
+    switch (stride) {
+    case 1: return 0;
+    case 2: return 1;
+    case 4: return 2;
+    }
+    return -1;
+}
+
+// Row conversion functions, indexed by source and destination strides
+static const ConvertRowFunc convert_row8_funcs[3][3] = {
+    { convert_row8_1_1, convert_row8_1_2, convert_row8_1_4 },
+    { convert_row8_2_1, convert_row8_2_2, convert_row8_2_4 },
+    { convert_row8_4_1, convert_row8_4_2, convert_row8_4_4 },
+};
+
+static const ConvertRowFunc convert_row16_funcs[2][2] = {
+    { convert_row16_2_2, convert_row16_2_4 },
+    { convert_row16_4_2, convert_row16_4_4 },
+};
+
+static const ConvertRowFunc convert_row8to16_funcs[3][2] = {
+    { convert_row8to16_1_2, convert_row8to16_1_4 },
+    { convert_row8to16_2_2, convert_row8to16_2_4 },
+    { convert_row8to16_4_2, convert_row8to16_4_4 },
+};
+
+static const ConvertRowFunc convert_row16to8_funcs[2][3] = {
+    { convert_row16to8_2_1, convert_row16to8_2_2, convert_row16to8_2_4 },
+    { convert_row16to8_4_1, convert_row16to8_4_2, convert_row16to8_4_4 },
+};
+
+// Determines the row conversion function for the supplied components
+static ConvertRowFunc
+get_convert_row_func(const VideoFormatComponentInfo *src_cip,
+    const VideoFormatComponentInfo *dst_cip)
+{
+    const unsigned src_bpc = (src_cip->bit_depth + 7) / 8;
+    const unsigned dst_bpc = (dst_cip->bit_depth + 7) / 8;
+    int i, j;
+
+    if (src_cip->pixel_offset >= src_cip->pixel_stride ||
+        dst_cip->pixel_offset >= dst_cip->pixel_stride)
+        return NULL;
+
+    i = get_stride_index(src_cip->pixel_stride / src_bpc);
+    j = get_stride_index(dst_cip->pixel_stride / dst_bpc);
+    if (i < 0 || j < 0)
+        return NULL;
+    if ((src_bpc == 2 && i > 1) || (dst_bpc == 2 && j > 1))
+        return NULL;
+
+    switch (src_bpc * 4 + dst_bpc) {
+    case 1*4 + 1:
+        return convert_row8_funcs[i][j];
+    case 1*4 + 2:
+        return convert_row8to16_funcs[i][j];
+    case 2*4 + 1:
+        return convert_row16to8_funcs[i][j];
+    case 2*4 + 2:
+        return convert_row16_funcs[i][j];
+    }
+    return NULL;
+}
+
+// Fills a component with the supplied value
+static void
+fill_component(MvtImage *image, const VideoFormatComponentInfo *cip,
+    unsigned width, unsigned height, uint32_t value)
+{
+    unsigned x, y;
+
+    for (y = 0; y < height; y++) {
+        uint8_t * const p = &image->pixels[cip->plane][
+            y * image->pitches[cip->plane] + cip->pixel_offset];
+
+        if (cip->bit_depth <= 8) {
+            for (x = 0; x < width; x++)
+                p[x * cip->pixel_stride] = value;
+        }
+        else {
+            for (x = 0; x < width; x++)
+                *(uint16_t *)&p[x * cip->pixel_stride] =
+                    value << cip->bit_shift;
+        }
+    }
+}
+
+/* Converts YUV images component by component, with row functions
+   specialized for the pixel strides. Samples are shifted up to a higher
+   bit depth, or rounded to nearest and clipped to a lower bit depth */
+static bool
+image_convert_generic(MvtImage *dst_image, const VideoFormatInfo *dst_vip,
+    MvtImage *src_image, const VideoFormatInfo *src_vip)
+{
+    const VideoFormatComponentInfo *src_cip, *dst_cip;
+    ConvertRowFunc func;
+    ConvertParams params;
+    unsigned i, y, width, height;
+
+    if (!video_format_is_yuv(src_vip->format) ||
+        !video_format_is_yuv(dst_vip->format))
+        return false;
+
+    for (i = 0; i < dst_vip->num_components; i++) {
+        dst_cip = &dst_vip->components[i];
+        src_cip = i < src_vip->num_components ? &src_vip->components[i] : NULL;
+        if (src_cip && !get_convert_row_func(src_cip, dst_cip))
+            return false;
+    }
+
+    for (i = 0; i < dst_vip->num_components; i++) {
+        const unsigned w_shift = i > 0 ? dst_vip->chroma_w_shift : 0;
+        const unsigned h_shift = i > 0 ? dst_vip->chroma_h_shift : 0;
+
+        width = (dst_image->width + (1U << w_shift) - 1) >> w_shift;
+        height = (dst_image->height + (1U << h_shift) - 1) >> h_shift;
+        dst_cip = &dst_vip->components[i];
+
+        // Opaque alpha channel if there is none in the source image
+        if (i >= src_vip->num_components) {
+            fill_component(dst_image, dst_cip, width, height,
+                (1U << dst_cip->bit_depth) - 1);
+            continue;
+        }
+        src_cip = &src_vip->components[i];
+        func = get_convert_row_func(src_cip, dst_cip);
+
+        params.src_offset = src_cip->pixel_offset;
+        params.src_shift = src_cip->bit_shift;
+        params.dst_offset = dst_cip->pixel_offset;
+        params.dst_shift = dst_cip->bit_shift;
+        params.mask = (1U << src_cip->bit_depth) - 1;
+        params.max_value = (1U << dst_cip->bit_depth) - 1;
+        params.up_shift = 0;
+        params.down_shift = 0;
+        params.rounding = 0;
+        if (dst_cip->bit_depth > src_cip->bit_depth)
+            params.up_shift = dst_cip->bit_depth - src_cip->bit_depth;
+        else if (dst_cip->bit_depth < src_cip->bit_depth) {
+            params.down_shift = src_cip->bit_depth - dst_cip->bit_depth;
+            params.rounding = 1U << (params.down_shift - 1);
+        }
+
+        for (y = 0; y < height; y++)
+            func(&dst_image->pixels[dst_cip->plane][
+                    y * dst_image->pitches[dst_cip->plane]],
+                &src_image->pixels[src_cip->plane][
+                    y * src_image->pitches[src_cip->plane]],
+                width, &params);
+    }
+    return true;
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- libyuv based conversions                                           --- */
 /* -------------------------------------------------------------------------- */
@@ -385,7 +1552,7 @@ static bool
 image_copy_internal(MvtImage *dst_image, MvtImage *src_image,
     const VideoFormatInfo *vip, uint32_t flags)
 {
-    unsigned i, y;
+    unsigned i, n, y, height;
 
     if (dst_image->format != src_image->format)
         return false;
@@ -395,12 +1562,20 @@ image_copy_internal(MvtImage *dst_image, MvtImage *src_image,
         return false;
 
     for (i = 0; i < dst_image->num_planes; i++) {
-        uint8_t *dst_pixels = dst_image->pixels[0];
+        uint8_t *dst_pixels = dst_image->pixels[i];
         const uint8_t *src_pixels = src_image->pixels[i];
         const uint32_t stride =
             MVT_MIN(dst_image->pitches[i], src_image->pitches[i]);
 
-        for (y = 0; y < dst_image->height; y++) {
+        // The plane height is the one of its first component
+        for (n = 0; n < vip->num_components; n++) {
+            if (vip->components[n].plane == i)
+                break;
+        }
+        height = n > 0 ? (dst_image->height + (1U << vip->chroma_h_shift) -
+            1) >> vip->chroma_h_shift : dst_image->height;
+
+        for (y = 0; y < height; y++) {
             memcpy(dst_pixels, src_pixels, stride);
             dst_pixels += dst_image->pitches[i];
             src_pixels += src_image->pitches[i];
@@ -409,6 +1584,53 @@ image_copy_internal(MvtImage *dst_image, MvtImage *src_image,
     return true;
 }
 
+// Converts P010/P016 images to I420P10/I420P16 respectively
+static bool
+image_convert_p01x(MvtImage *dst_image, MvtImage *src_image, bool from_uswc)
+{
+    const VideoFormatInfo *vip;
+    unsigned i, x, y, shift;
+
+    if (!(src_image->format == VIDEO_FORMAT_P010 &&
+          dst_image->format == VIDEO_FORMAT_I420P10) &&
+        !(src_image->format == VIDEO_FORMAT_P016 &&
+          dst_image->format == VIDEO_FORMAT_I420P16))
+        return false;
+
+    vip = video_format_get_info(src_image->format);
+    shift = vip->components[0].bit_shift;
+
+#if USE_SSE_COPY
+    if (SSE_CopyFromP01x(dst_image, src_image, shift, from_uswc))
+        return true;
+#endif
+
+    for (y = 0; y < dst_image->height; y++) {
+        const uint16_t * const src = (uint16_t *)
+            (src_image->pixels[0] + y * src_image->pitches[0]);
+        uint16_t * const dst = (uint16_t *)
+            (dst_image->pixels[0] + y * dst_image->pitches[0]);
+
+        for (x = 0; x < dst_image->width; x++)
+            dst[x] = src[x] >> shift;
+    }
+
+    for (y = 0; y < (dst_image->height + 1) / 2; y++) {
+        const uint16_t * const src = (uint16_t *)
+            (src_image->pixels[1] + y * src_image->pitches[1]);
+        uint16_t *dst[2];
+
+        for (i = 0; i < 2; i++)
+            dst[i] = (uint16_t *)
+                (dst_image->pixels[1 + i] + y * dst_image->pitches[1 + i]);
+        for (x = 0; x < (dst_image->width + 1) / 2; x++) {
+            dst[0][x] = src[2*x+0] >> shift;
+            dst[1][x] = src[2*x+1] >> shift;
+        }
+    }
+    return true;
+}
+
 // Accelerated downloads from Uncached Speculative Write Combining memory
 static bool
 image_convert_uswc(MvtImage *dst_image, MvtImage *src_image, uint32_t flags)
@@ -432,7 +1654,7 @@ image_convert_uswc(MvtImage *dst_image, MvtImage *src_image, uint32_t flags)
         }
     }
 #endif
-    return false;
+    return image_convert_p01x(dst_image, src_image, true);
 }
 
 // Converts images with the same size
@@ -443,6 +1665,9 @@ image_convert_internal(MvtImage *dst_image, const VideoFormatInfo *dst_vip,
     if (image_convert_uswc(dst_image, src_image, flags))
         return true;
 
+    if (image_convert_p01x(dst_image, src_image, false))
+        return true;
+
     if (src_image->format == VIDEO_FORMAT_NV12 &&
         dst_image->format == VIDEO_FORMAT_I420)
         return NV12ToI420(src_image->pixels[0], src_image->pitches[0],
@@ -482,6 +1707,9 @@ image_convert_internal(MvtImage *dst_image, const VideoFormatInfo *dst_vip,
     if (src_image->format == dst_image->format)
         return image_copy_internal(dst_image, src_image, dst_vip, flags);
 
+    if (image_convert_generic(dst_image, dst_vip, src_image, src_vip))
+        return true;
+
     mvt_error("image: unsupported conversion (%s -> %s)",
         src_vip->name, dst_vip->name);
     return false;
@@ -529,6 +1757,14 @@ mvt_image_convert_full(MvtImage *dst_image, MvtImage *src_image, uint32_t flags)
         return image_convert_internal(dst_image, dst_vip, src_image, src_vip,
             flags);
 
+    /* Conversions never mix lines, so converting both fields amounts to
+       converting the whole frame, in memory order and in a single pass.
+       This holds as long as the fields evenly split every plane */
+    if (field_flags == (VA_TOP_FIELD|VA_BOTTOM_FIELD) &&
+        (dst_image->height % (2U << dst_vip->chroma_h_shift)) == 0)
+        return image_convert_internal(dst_image, dst_vip, src_image, src_vip,
+            flags);
+
     if (flags & VA_TOP_FIELD) {
         mvt_image_init_from_field(&src_image_tmp, src_image, VA_TOP_FIELD);
         mvt_image_init_from_field(&dst_image_tmp, dst_image, VA_TOP_FIELD);
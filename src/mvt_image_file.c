@@ -22,29 +22,79 @@
 
 #include "sysdeps.h"
 #include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include "mvt_image_file.h"
 #include "mvt_image_priv.h"
+#include "mvt_memory.h"
+
+// Max number of buffers in a single writev() call
+#ifdef IOV_MAX
+# define MAX_IOV IOV_MAX
+#else
+# define MAX_IOV 1024
+#endif
 
 typedef bool (*MvtImageFileWriteHeaderFunc)(MvtImageFile *fp);
 typedef bool (*MvtImageFileWriteImageFunc)(MvtImageFile *fp, MvtImage *image);
 typedef bool (*MvtImageFileReadHeaderFunc)(MvtImageFile *fp);
 typedef bool (*MvtImageFileReadImageFunc)(MvtImageFile *fp, MvtImage *image);
+typedef bool (*MvtImageFileSeekFunc)(MvtImageFile *fp, uint32_t frame);
+typedef MvtImage *(*MvtImageFileMapImageFunc)(MvtImageFile *fp,
+    MvtImagePool *pool);
+typedef uint32_t (*MvtImageFileGetNumFramesFunc)(MvtImageFile *fp);
 
 typedef struct {
     MvtImageFileWriteHeaderFunc write_header;
     MvtImageFileWriteImageFunc  write_image;
     MvtImageFileReadHeaderFunc  read_header;
     MvtImageFileReadImageFunc   read_image;
+    MvtImageFileSeekFunc        seek;
+    MvtImageFileMapImageFunc    map_image;
+    MvtImageFileGetNumFramesFunc get_num_frames;
 } MvtImageFileClass;
 
+// Read-only mapping of a whole file, shared with the images viewing it
+typedef struct {
+    uint32_t                    ref_count;
+    uint8_t *                   base;
+    size_t                      size;
+} MvtImageFileMapping;
+
 struct MvtImageFile_s {
     FILE *                      file;
+    char *                      path;
     MvtImageFileMode            mode;
     MvtImageInfo                info;
     bool                        info_ready;
     const MvtImageFileClass *   klass;
+    off_t                       data_offset;    // offset of the first frame
+    uint64_t                    frame_size;     // size of frame data
+    uint32_t                    frame;          // index of the next frame
+    bool                        is_seekable;    // frames can be located
+    bool                        has_frame_params;
+    off_t *                     frame_offsets;  // index of frame offsets
+    uint32_t                    num_frame_offsets;
+    uint32_t                    max_frame_offsets;
+    bool                        index_complete; // all frames are indexed
+    uint64_t                    file_size;      // size when opened for read
+    struct timespec             file_mtime;     // mtime when opened for read
+    struct iovec *              iov;            // buffers of the next write
+    uint32_t                    num_iov;
+    uint32_t                    max_iov;
+    MvtImageFileMapping *       map;            // file mapping, if any
 };
 
+// Number of frames to read ahead from file mappings
+#define MAP_READAHEAD_FRAMES 2
+
+// Size of the stdio buffer for reads, e.g. to parse FRAME headers
+#define READ_BUFFER_SIZE (64 * 1024)
+
 // Default framerate (60 fps)
 #define DEFAULT_FPS_N 60
 #define DEFAULT_FPS_D 1
@@ -57,98 +107,165 @@ struct MvtImageFile_s {
 /* --- Helpers                                                          --- */
 /* ------------------------------------------------------------------------ */
 
-typedef struct {
-    char *      str;
-    uint32_t    len;
-    uint32_t    maxlen;
-} Token;
-
-static void
-token_init(Token *token)
+/* Splits the next whitespace separated token from the string, in place.
+   Returns NULL if there is none */
+static char *
+str_next_token(char **str_ptr)
 {
-    memset(token, 0, sizeof(*token));
+    char *str = *str_ptr, *token;
+
+    while (isspace((unsigned char)*str))
+        str++;
+    if (!*str)
+        return NULL;
+
+    token = str;
+    while (*str && !isspace((unsigned char)*str))
+        str++;
+    if (*str)
+        *str++ = '\0';
+    *str_ptr = str;
+    return token;
 }
 
-static void
-token_clear(Token *token)
+static bool
+str_parse_uint(const char *str, char **end_ptr, uint32_t *value_ptr)
 {
-    free(token->str);
-    token->len = 0;
-    token->maxlen = 0;
+    unsigned long v;
+    char *end = NULL;
+
+    v = strtoul(str, &end, 10);
+    if (end == str)
+        return false;
+
+    if (end_ptr)
+        *end_ptr = end;
+    if (value_ptr)
+        *value_ptr = v;
+    return true;
 }
 
+/* Appends a buffer to the list of buffers to write. Contiguous buffers,
+   e.g. rows of planes with no padding, are merged */
 static bool
-token_append(Token *token, char *buf, uint32_t buf_size)
+iov_append(MvtImageFile *fp, const void *base, size_t len)
 {
-    char *str;
-    uint32_t len;
-
-    if (!buf || !buf_size)
-        return true;
+    struct iovec *iov;
+    uint32_t max_iov;
+
+    if (fp->num_iov > 0) {
+        iov = &fp->iov[fp->num_iov - 1];
+        if ((const uint8_t *)iov->iov_base + iov->iov_len == base) {
+            iov->iov_len += len;
+            return true;
+        }
+    }
 
-    len = token->len + buf_size + 1;
-    if (len > token->maxlen) {
-        len += (len >> 3) + 1; // +~12%
-        str = realloc(token->str, len);
-        if (!str)
+    if (fp->num_iov == fp->max_iov) {
+        max_iov = MVT_MAX(fp->max_iov * 2, 64);
+        iov = realloc(fp->iov, max_iov * sizeof(*iov));
+        if (!iov)
             return false;
-        token->str = str;
-        token->maxlen = len;
+        fp->iov = iov;
+        fp->max_iov = max_iov;
     }
-    memcpy(token->str + token->len, buf, buf_size);
-    token->len += buf_size;
-    token->str[token->len] = '\0';
+    iov = &fp->iov[fp->num_iov++];
+    iov->iov_base = (void *)base;
+    iov->iov_len = len;
     return true;
 }
 
+/* Writes the list of buffers straight to the file descriptor, with as
+   few writev() calls as possible. The list is reset afterwards */
 static bool
-token_read(Token *token, FILE *fp, char *sep_ptr)
+iov_flush(MvtImageFile *fp)
 {
-    char sep, buf[BUFSIZ];
-    int c, buf_size = 0;
-
-    if (!sep_ptr)
-        sep_ptr = &sep;
+    struct iovec *iov = fp->iov;
+    uint32_t num_iov = fp->num_iov;
+    ssize_t ret;
+    int fd;
 
-    if (feof(fp)) {
-        *sep_ptr = EOF;
+    fp->num_iov = 0;
+    if (fflush(fp->file) != 0)
         return false;
-    }
+    fd = fileno(fp->file);
 
-    *sep_ptr = '\0';
-    token->len = 0;
-    while ((c = fgetc(fp)) != EOF && !isspace(c)) {
-        buf[buf_size++] = c;
-        if (buf_size == sizeof(buf)) {
-            if (!token_append(token, buf, buf_size))
-                return false;
-            buf_size = 0;
+    while (num_iov > 0) {
+        ret = writev(fd, iov, MVT_MIN(num_iov, MAX_IOV));
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
         }
-    }
-    if (!token_append(token, buf, buf_size))
-        return false;
 
-    *sep_ptr = c;
+        // Skip the buffers that were written, and resume partial writes
+        for (; num_iov > 0 && (size_t)ret >= iov->iov_len; num_iov--, iov++)
+            ret -= iov->iov_len;
+        if (num_iov > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
     return true;
 }
 
+// Maps the whole file in memory, for sequential reads
 static bool
-str_parse_uint(const char *str, char **end_ptr, uint32_t *value_ptr)
+file_map(MvtImageFile *fp)
 {
-    unsigned long v;
-    char *end = NULL;
+    MvtImageFileMapping *map;
+    struct stat st;
+    void *base;
 
-    v = strtoul(str, &end, 10);
-    if (end == str)
+    if (fstat(fileno(fp->file), &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+    if (st.st_size <= 0 || (uint64_t)st.st_size > SIZE_MAX)
         return false;
 
-    if (end_ptr)
-        *end_ptr = end;
-    if (value_ptr)
-        *value_ptr = v;
+    map = malloc(sizeof(*map));
+    if (!map)
+        return false;
+
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp->file), 0);
+    if (base == MAP_FAILED) {
+        free(map);
+        return false;
+    }
+    madvise(base, st.st_size, MADV_SEQUENTIAL);
+
+    map->ref_count = 1;
+    map->base = base;
+    map->size = st.st_size;
+    fp->map = map;
     return true;
 }
 
+// Drops a reference to the file mapping, and unmaps it on the last one
+static void
+file_mapping_unref(void *user_data)
+{
+    MvtImageFileMapping * const map = user_data;
+
+    if (!map || __sync_sub_and_fetch(&map->ref_count, 1) > 0)
+        return;
+    munmap(map->base, map->size);
+    free(map);
+}
+
+// Starts reading the supplied range of the file mapping in the background
+static void
+file_map_readahead(MvtImageFile *fp, uint64_t offset, uint64_t size)
+{
+    MvtImageFileMapping * const map = fp->map;
+    const uint64_t page_mask = sysconf(_SC_PAGESIZE) - 1;
+    uint64_t start, end;
+
+    start = offset & ~page_mask;
+    end = MVT_MIN(offset + size, map->size);
+    if (start < end)
+        madvise(map->base + start, end - start, MADV_WILLNEED);
+}
+
 /* ------------------------------------------------------------------------ */
 /* --- Y4M Format (YUV)                                                 --- */
 /* ------------------------------------------------------------------------ */
@@ -302,13 +419,15 @@ y4m_write_header(MvtImageFile *fp)
     return true;
 }
 
-// Writes image component to Y4M file
+/* Queues the rows of an image component for writing to Y4M file. Rows
+   of packed components are gathered into scratch memory first */
 static bool
 y4m_write_image_component(MvtImageFile *fp, MvtImage *image,
     const VideoFormatInfo *vip, uint32_t n)
 {
     const VideoFormatComponentInfo * const cip = &vip->components[n];
     const uint8_t *p;
+    uint8_t *buf;
     uint32_t x, y, w, h, stride, bpc;
 
     w = image->width;
@@ -324,62 +443,439 @@ y4m_write_image_component(MvtImageFile *fp, MvtImage *image,
     p = get_component_ptr(image, cip, 0, 0);
     if (cip->pixel_stride == bpc) {
         for (y = 0; y < h; y++) {
-            if (fwrite(p, w, bpc, fp->file) != bpc)
+            if (!iov_append(fp, p, w * bpc))
                 return false;
             p += stride;
         }
+        return true;
     }
-    else {
-        for (y = 0; y < h; y++) {
-            for (x = 0; x < w; x++) {
-                if (fwrite(p + x * cip->pixel_stride, bpc, 1, fp->file) != 1)
-                    return false;
-            }
-            p += stride;
+
+    buf = mem_scratch_alloc((size_t)w * h * bpc, 16);
+    if (!buf)
+        return false;
+    if (!iov_append(fp, buf, (size_t)w * h * bpc))
+        return false;
+
+    for (y = 0; y < h; y++) {
+        if (bpc == 1) {
+            for (x = 0; x < w; x++)
+                *buf++ = p[x * cip->pixel_stride];
         }
+        else {
+            for (x = 0; x < w; x++, buf += bpc)
+                memcpy(buf, p + x * cip->pixel_stride, bpc);
+        }
+        p += stride;
     }
     return true;
 }
 
-// Writes image to Y4M file
+/* Writes image to Y4M file. The FRAME header and all the rows are written
+   with writev(), straight from the image pixels */
 static bool
 y4m_write_image(MvtImageFile *fp, MvtImage *image)
 {
+    static const char frame_tag[] = "FRAME\n";
     const VideoFormatInfo * const vip = video_format_get_info(fp->info.format);
+    const MemScratchMark mark = mem_scratch_mark();
+    bool success = false;
 
-    fprintf(fp->file, "FRAME\n");
+    fp->num_iov = 0;
+    if (!iov_append(fp, frame_tag, sizeof(frame_tag) - 1))
+        goto cleanup;
     if (!y4m_write_image_component(fp, image, vip, 0)) // Y
-        return false;
+        goto cleanup;
     if (vip->num_components > 1) {
         if (!y4m_write_image_component(fp, image, vip, 1)) // Cb
-            return false;
+            goto cleanup;
         if (!y4m_write_image_component(fp, image, vip, 2)) // Cr
-            return false;
+            goto cleanup;
     }
     if (vip->num_components > 3) {
         if (!y4m_write_image_component(fp, image, vip, 3)) // Alpha
+            goto cleanup;
+    }
+    success = iov_flush(fp);
+
+cleanup:
+    mem_scratch_release(&mark);
+    return success;
+}
+
+// Determines the size of the frame data, i.e. without the FRAME header
+static uint64_t
+y4m_get_frame_size(const MvtImageInfo *info)
+{
+    const VideoFormatInfo * const vip = video_format_get_info(info->format);
+    uint64_t frame_size = 0;
+    uint32_t n, w, h;
+
+    if (!vip)
+        return 0;
+
+    for (n = 0; n < MVT_MIN(vip->num_components, 4); n++) {
+        const VideoFormatComponentInfo * const cip = &vip->components[n];
+
+        w = info->width;
+        h = info->height;
+        if (n > 0 && n < 3) {
+            w = (w + (1U << vip->chroma_w_shift) - 1) >> vip->chroma_w_shift;
+            h = (h + (1U << vip->chroma_h_shift) - 1) >> vip->chroma_h_shift;
+        }
+        frame_size += (uint64_t)w * h * ((cip->bit_depth + 7) / 8);
+    }
+    return frame_size;
+}
+
+/* Reads the FRAME header at the current position. Returns the length of
+   the header, or zero if there is none. Frame parameters are skipped in
+   chunks, straight from the stdio buffer, with no allocation */
+static uint32_t
+y4m_read_frame_header(MvtImageFile *fp, bool *has_params_ptr)
+{
+    static const char frame_tag[] = "FRAME";
+    char buf[64];
+    uint32_t len = 0, n;
+
+    do {
+        if (!fgets(buf, sizeof(buf), fp->file))
+            return 0;
+        n = strlen(buf);
+        if (len == 0 && (n < sizeof(frame_tag) - 1 ||
+                memcmp(buf, frame_tag, sizeof(frame_tag) - 1) != 0))
+            return 0;
+        len += n;
+    } while (n == 0 || buf[n - 1] != '\n');
+
+    *has_params_ptr = len != sizeof("FRAME\n") - 1;
+    return len;
+}
+
+/* Determines the layout of frames in file. Frames are located at fixed
+   offsets, unless FRAME headers carry parameters. Streams that cannot
+   seek, e.g. pipes, can only be read in order */
+static bool
+y4m_init_frame_layout(MvtImageFile *fp)
+{
+    bool has_params = false;
+
+    fp->frame_size = y4m_get_frame_size(&fp->info);
+    fp->frame = 0;
+    fp->num_frame_offsets = 0;
+    fp->has_frame_params = false;
+
+    fp->data_offset = ftello(fp->file);
+    if (fp->data_offset < 0) {
+        fp->data_offset = 0;
+        fp->is_seekable = false;
+        return errno == ESPIPE;
+    }
+    fp->is_seekable = true;
+
+    // Check the first FRAME header, if any, and rewind to it
+    y4m_read_frame_header(fp, &has_params);
+    fp->has_frame_params = has_params;
+    return fseeko(fp->file, fp->data_offset, SEEK_SET) == 0;
+}
+
+// Appends the supplied frame offset to the index
+static bool
+y4m_index_append(MvtImageFile *fp, off_t offset)
+{
+    off_t *frame_offsets;
+    uint32_t max_frame_offsets;
+
+    if (fp->num_frame_offsets == fp->max_frame_offsets) {
+        max_frame_offsets = MVT_MAX(fp->max_frame_offsets * 2, 64);
+        frame_offsets = realloc(fp->frame_offsets,
+            max_frame_offsets * sizeof(*frame_offsets));
+        if (!frame_offsets)
             return false;
+        fp->frame_offsets = frame_offsets;
+        fp->max_frame_offsets = max_frame_offsets;
     }
+    fp->frame_offsets[fp->num_frame_offsets++] = offset;
     return true;
 }
 
+// Sidecar index file identifier, and header
+#define Y4M_INDEX_MAGIC "MVTY4MI1"
+
+typedef struct {
+    char        magic[8];
+    uint64_t    file_size;      // Size of the indexed file
+    int64_t     mtime_sec;      // Modification time of the indexed file
+    int64_t     mtime_nsec;
+    uint64_t    data_offset;
+    uint64_t    frame_size;
+    uint32_t    num_offsets;
+    uint32_t    reserved;
+} Y4MIndexHeader;
+
+// Returns the path to the sidecar index file, to be freed by the caller
+static char *
+y4m_index_get_path(MvtImageFile *fp)
+{
+    char *path;
+
+    if (!fp->path || !fp->file_size)
+        return NULL;
+
+    path = malloc(strlen(fp->path) + 4 /* ".idx" */ + 1);
+    if (!path)
+        return NULL;
+    strcpy(path, fp->path);
+    strcat(path, ".idx");
+    return path;
+}
+
+// Fills in the sidecar index header for the current file
+static void
+y4m_index_init_header(MvtImageFile *fp, Y4MIndexHeader *hdr)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, Y4M_INDEX_MAGIC, sizeof(hdr->magic));
+    hdr->file_size = fp->file_size;
+    hdr->mtime_sec = fp->file_mtime.tv_sec;
+    hdr->mtime_nsec = fp->file_mtime.tv_nsec;
+    hdr->data_offset = fp->data_offset;
+    hdr->frame_size = fp->frame_size;
+    hdr->num_offsets = fp->num_frame_offsets;
+}
+
+/* Loads the complete index from the sidecar index file. The index is
+   discarded if the file was modified since it was built */
+static bool
+y4m_index_load(MvtImageFile *fp)
+{
+    Y4MIndexHeader hdr, ref_hdr;
+    FILE *index_file = NULL;
+    char *path;
+    uint64_t offset;
+    uint32_t i;
+    bool success = false;
+
+    path = y4m_index_get_path(fp);
+    if (!path)
+        return false;
+    index_file = fopen(path, "rb");
+    if (!index_file)
+        goto cleanup;
+
+    if (fread(&hdr, sizeof(hdr), 1, index_file) != 1)
+        goto cleanup;
+    y4m_index_init_header(fp, &ref_hdr);
+    ref_hdr.num_offsets = hdr.num_offsets;
+    if (memcmp(&hdr, &ref_hdr, sizeof(hdr)) != 0 || hdr.num_offsets == 0)
+        goto cleanup;
+
+    fp->num_frame_offsets = 0;
+    for (i = 0; i < hdr.num_offsets; i++) {
+        if (fread(&offset, sizeof(offset), 1, index_file) != 1)
+            goto cleanup;
+        if (!y4m_index_append(fp, offset))
+            goto cleanup;
+    }
+    success = fp->frame_offsets[0] == fp->data_offset;
+
+cleanup:
+    if (!success)
+        fp->num_frame_offsets = 0;
+    if (index_file)
+        fclose(index_file);
+    free(path);
+    return success;
+}
+
+/* Saves the complete index to the sidecar index file. The file is
+   replaced atomically, so that concurrent readers never see it partial */
+static bool
+y4m_index_save(MvtImageFile *fp)
+{
+    Y4MIndexHeader hdr;
+    FILE *index_file = NULL;
+    char *path, *tmp_path = NULL;
+    uint64_t offset;
+    uint32_t i;
+    int fd;
+    bool success = false;
+
+    path = y4m_index_get_path(fp);
+    if (!path)
+        return false;
+    tmp_path = malloc(strlen(path) + 7 /* ".XXXXXX" */ + 1);
+    if (!tmp_path)
+        goto cleanup;
+    sprintf(tmp_path, "%s.XXXXXX", path);
+
+    fd = mkstemp(tmp_path);
+    if (fd < 0)
+        goto cleanup;
+    index_file = fdopen(fd, "wb");
+    if (!index_file) {
+        close(fd);
+        goto cleanup;
+    }
+
+    y4m_index_init_header(fp, &hdr);
+    if (fwrite(&hdr, sizeof(hdr), 1, index_file) != 1)
+        goto cleanup;
+    for (i = 0; i < fp->num_frame_offsets; i++) {
+        offset = fp->frame_offsets[i];
+        if (fwrite(&offset, sizeof(offset), 1, index_file) != 1)
+            goto cleanup;
+    }
+    success = fclose(index_file) == 0;
+    index_file = NULL;
+    if (success)
+        success = rename(tmp_path, path) == 0;
+
+cleanup:
+    if (index_file)
+        fclose(index_file);
+    if (!success && tmp_path)
+        unlink(tmp_path);
+    if (!success)
+        mvt_info("could not save frame index to `%s'", path);
+    free(tmp_path);
+    free(path);
+    return success;
+}
+
+/* Scans the file, from the last indexed frame, until the supplied frame
+   is indexed. Only FRAME headers are read, frame data is skipped. Once
+   all frames are indexed, the index is saved to a sidecar file */
+static bool
+y4m_index_frames(MvtImageFile *fp, uint32_t frame)
+{
+    off_t offset;
+    uint32_t len;
+    bool has_params;
+
+    if (!fp->num_frame_offsets) {
+        fp->index_complete = y4m_index_load(fp);
+        if (!fp->index_complete && !y4m_index_append(fp, fp->data_offset))
+            return false;
+    }
+
+    while (fp->num_frame_offsets <= frame + 1) {
+        if (fp->index_complete)
+            return false;
+
+        offset = fp->frame_offsets[fp->num_frame_offsets - 1];
+        if (fseeko(fp->file, offset, SEEK_SET) != 0)
+            return false;
+        len = y4m_read_frame_header(fp, &has_params);
+        if (!len || (fp->file_size > 0 &&
+                     offset + len + fp->frame_size > fp->file_size)) {
+            clearerr(fp->file);
+            fp->index_complete = true;
+            y4m_index_save(fp);
+            return false;
+        }
+        if (!y4m_index_append(fp, offset + len + fp->frame_size))
+            return false;
+    }
+    return true;
+}
+
+// Seeks to the supplied frame in Y4M file
+static bool
+y4m_seek(MvtImageFile *fp, uint32_t frame)
+{
+    off_t offset;
+    bool has_params = false;
+
+    // Only the next frame can be reached in streams that cannot seek
+    if (!fp->is_seekable)
+        return frame == fp->frame;
+
+    if (!fp->has_frame_params) {
+        offset = fp->data_offset +
+            (off_t)frame * (sizeof("FRAME\n") - 1 + fp->frame_size);
+        if (fseeko(fp->file, offset, SEEK_SET) != 0)
+            return false;
+
+        // Check the whole frame is really there, and rewind to it
+        if (fp->file_size > 0 && (uint64_t)offset + sizeof("FRAME\n") - 1 +
+            fp->frame_size > fp->file_size)
+            return false;
+        if (y4m_read_frame_header(fp, &has_params) && !has_params) {
+            if (fseeko(fp->file, offset, SEEK_SET) != 0)
+                return false;
+            fp->frame = frame;
+            return true;
+        }
+        if (feof(fp->file)) {
+            clearerr(fp->file);
+            return false;
+        }
+
+        // Some FRAME headers carry parameters, use an index from now on
+        fp->has_frame_params = true;
+    }
+
+    if (!y4m_index_frames(fp, frame))
+        return false;
+    if (fseeko(fp->file, fp->frame_offsets[frame], SEEK_SET) != 0)
+        return false;
+    fp->frame = frame;
+    return true;
+}
+
+// Determines the number of frames in Y4M file
+static uint32_t
+y4m_get_num_frames(MvtImageFile *fp)
+{
+    const off_t offset = ftello(fp->file);
+    const uint32_t frame = fp->frame;
+    uint64_t num_frames = 0;
+
+    if (!fp->is_seekable || offset < 0)
+        return 0;
+
+    // Check the last frame is where expected, otherwise use an index
+    if (!fp->has_frame_params && fp->file_size > (uint64_t)fp->data_offset) {
+        num_frames = (fp->file_size - fp->data_offset) /
+            (sizeof("FRAME\n") - 1 + fp->frame_size);
+        num_frames = MVT_MIN(num_frames, UINT32_MAX);
+        if (num_frames > 0 && !y4m_seek(fp, num_frames - 1))
+            num_frames = 0;
+    }
+
+    if (fp->has_frame_params) {
+        y4m_index_frames(fp, UINT32_MAX - 1);
+        num_frames = fp->index_complete ? fp->num_frame_offsets - 1 : 0;
+    }
+
+    if (fseeko(fp->file, offset, SEEK_SET) != 0)
+        return 0;
+    fp->frame = frame;
+    return num_frames;
+}
+
 // Reads Y4M headers
 static bool
 y4m_read_header(MvtImageFile *fp)
 {
     MvtImageInfo * const info = &fp->info;
-    Token token;
-    char sep = 0, *end;
+    char *line = NULL, *next, *str, *end;
+    size_t line_size = 0;
+    ssize_t len;
     bool success = false;
     uint32_t v0, v1;
 
-    token_init(&token);
-    if (!token_read(&token, fp->file, &sep))
+    // The header is a single line, tokenized in place
+    len = getline(&line, &line_size, fp->file);
+    if (len <= 0 || line[len - 1] != '\n')
         goto cleanup;
-    if (strcmp(token.str, Y4M_HEADER_TAG) != 0)
+    line[len - 1] = '\0';
+
+    next = line;
+    str = str_next_token(&next);
+    if (!str || strcmp(str, Y4M_HEADER_TAG) != 0)
         goto cleanup;
-    while (!success && token_read(&token, fp->file, &sep)) {
-        const char * const str = token.str;
+    while ((str = str_next_token(&next)) != NULL) {
         switch (str[0]) {
         case 'W':
             if (str_parse_uint(&str[1], NULL, &v0))
@@ -414,11 +910,11 @@ y4m_read_header(MvtImageFile *fp)
             mvt_warning("unsupported token `%s'", str);
             break;
         }
-        success = sep == '\n';
     }
+    success = y4m_init_frame_layout(fp);
 
 cleanup:
-    token_clear(&token);
+    free(line);
     return success;
 }
 
@@ -461,24 +957,183 @@ y4m_read_image_component(MvtImageFile *fp, MvtImage *image,
     return true;
 }
 
+/* Locates the next frame in the file mapping, and advances past it.
+   Returns the frame data, i.e. past the FRAME header, or NULL if none */
+static const uint8_t *
+y4m_map_frame(MvtImageFile *fp)
+{
+    static const char frame_tag[] = "FRAME";
+    MvtImageFileMapping * const map = fp->map;
+    const uint8_t *p, *end;
+    off_t offset;
+
+    offset = ftello(fp->file);
+    if (offset < 0 || (uint64_t)offset >= map->size)
+        return NULL;
+
+    p = map->base + offset;
+    end = map->base + map->size;
+    if ((size_t)(end - p) < sizeof(frame_tag) - 1 ||
+        memcmp(p, frame_tag, sizeof(frame_tag) - 1) != 0)
+        return NULL;
+    p = memchr(p, '\n', end - p);
+    if (!p)
+        return NULL;
+    if ((uint64_t)(end - ++p) < fp->frame_size)
+        return NULL;
+
+    offset = (p - map->base) + fp->frame_size;
+    if (fseeko(fp->file, offset, SEEK_SET) != 0)
+        return NULL;
+    file_map_readahead(fp, offset, MAP_READAHEAD_FRAMES *
+        (sizeof("FRAME\n") - 1 + fp->frame_size));
+    fp->frame++;
+    return p;
+}
+
+/* Copies image component from Y4M frame data. Returns the position of
+   the next component */
+static const uint8_t *
+y4m_copy_image_component(MvtImage *image, const VideoFormatInfo *vip,
+    uint32_t n, const uint8_t *src)
+{
+    const VideoFormatComponentInfo * const cip = &vip->components[n];
+    uint8_t *p;
+    uint32_t x, y, w, h, stride, bpc;
+
+    w = image->width;
+    h = image->height;
+    if (n > 0) {
+        w = (w + (1U << vip->chroma_w_shift) - 1) >> vip->chroma_w_shift;
+        h = (h + (1U << vip->chroma_h_shift) - 1) >> vip->chroma_h_shift;
+    }
+    stride = image->pitches[cip->plane];
+
+    bpc = (cip->bit_depth + 7) / 8; // bytes per component
+
+    p = get_component_ptr(image, cip, 0, 0);
+    for (y = 0; y < h; y++) {
+        if (cip->pixel_stride == bpc) {
+            memcpy(p, src, w * bpc);
+            src += w * bpc;
+        }
+        else {
+            for (x = 0; x < w; x++, src += bpc)
+                memcpy(p + x * cip->pixel_stride, src, bpc);
+        }
+        p += stride;
+    }
+    return src;
+}
+
+// Copies image from Y4M frame data
+static void
+y4m_copy_image(MvtImage *image, const VideoFormatInfo *vip,
+    const uint8_t *src)
+{
+    uint32_t n;
+
+    for (n = 0; n < MVT_MIN(vip->num_components, 4); n++)
+        src = y4m_copy_image_component(image, vip, n, src);
+}
+
+/* Checks whether frames can be viewed in place, i.e. whether components
+   are stored in separate planes, in Y4M order, and suitably aligned */
+static bool
+y4m_can_view_image(const VideoFormatInfo *vip, const uint8_t *src)
+{
+    uint32_t n, bpc;
+
+    if (vip->num_planes != vip->num_components)
+        return false;
+
+    for (n = 0; n < vip->num_components; n++) {
+        const VideoFormatComponentInfo * const cip = &vip->components[n];
+
+        bpc = (cip->bit_depth + 7) / 8;
+        if (cip->plane != n || cip->pixel_stride != bpc)
+            return false;
+        if ((uintptr_t)src & (bpc - 1))
+            return false;
+    }
+    return true;
+}
+
+// Initializes MvtImage object as a view into Y4M frame data
+static void
+y4m_init_image_view(MvtImage *image, const MvtImageInfo *info,
+    const VideoFormatInfo *vip, const uint8_t *src)
+{
+    uint32_t n, w, h, offset = 0;
+
+    memset(image, 0, sizeof(*image));
+    image->format = info->format;
+    image->width = info->width;
+    image->height = info->height;
+    image->num_planes = vip->num_planes;
+
+    for (n = 0; n < vip->num_components; n++) {
+        const VideoFormatComponentInfo * const cip = &vip->components[n];
+
+        w = info->width;
+        h = info->height;
+        if (n > 0) {
+            w = (w + (1U << vip->chroma_w_shift) - 1) >> vip->chroma_w_shift;
+            h = (h + (1U << vip->chroma_h_shift) - 1) >> vip->chroma_h_shift;
+        }
+        image->offsets[n] = offset;
+        image->pitches[n] = w * cip->pixel_stride;
+        image->pixels[n] = (uint8_t *)src + offset;
+        offset += image->pitches[n] * h;
+    }
+}
+
+/* Returns the next image from the Y4M file mapping. The image is a view
+   into the mapping if possible, or a copy from it otherwise */
+static MvtImage *
+y4m_map_image(MvtImageFile *fp, MvtImagePool *pool)
+{
+    const VideoFormatInfo * const vip = video_format_get_info(fp->info.format);
+    const uint8_t *src;
+    MvtImage view, *image;
+
+    src = y4m_map_frame(fp);
+    if (!src)
+        return NULL;
+
+    if (!y4m_can_view_image(vip, src)) {
+        image = mvt_image_pool_acquire(pool, fp->info.format,
+            fp->info.width, fp->info.height);
+        if (image)
+            y4m_copy_image(image, vip, src);
+        return image;
+    }
+
+    y4m_init_image_view(&view, &fp->info, vip, src);
+    __sync_add_and_fetch(&fp->map->ref_count, 1);
+    image = mvt_image_new_wrapped(&view, file_mapping_unref, fp->map);
+    if (!image)
+        file_mapping_unref(fp->map);
+    return image;
+}
+
 // Reads image from Y4M file
 static bool
 y4m_read_image(MvtImageFile *fp, MvtImage *image)
 {
     const VideoFormatInfo * const vip = video_format_get_info(fp->info.format);
-    Token token;
-    char sep = 0;
-    bool success = false;
+    const uint8_t *src;
+    bool has_params;
 
-    token_init(&token);
-    while (token_read(&token, fp->file, &sep) && sep != EOF) {
-        if (strcmp(token.str, "FRAME") == 0)
-            success = true;
-        if (sep == '\n')
-            break;
+    if (fp->map) {
+        src = y4m_map_frame(fp);
+        if (!src)
+            return false;
+        y4m_copy_image(image, vip, src);
+        return true;
     }
-    token_clear(&token);
-    if (!success)
+
+    if (!y4m_read_frame_header(fp, &has_params))
         return false;
 
     if (!y4m_read_image_component(fp, image, vip, 0)) // Y
@@ -493,6 +1148,7 @@ y4m_read_image(MvtImageFile *fp, MvtImage *image)
         if (!y4m_read_image_component(fp, image, vip, 3)) // Alpha
             return false;
     }
+    fp->frame++;
     return true;
 }
 
@@ -501,6 +1157,9 @@ static const MvtImageFileClass mvt_image_file_class_Y4M = {
     .write_image = y4m_write_image,
     .read_header = y4m_read_header,
     .read_image = y4m_read_image,
+    .seek = y4m_seek,
+    .map_image = y4m_map_image,
+    .get_num_frames = y4m_get_num_frames,
 };
 
 /* ------------------------------------------------------------------------ */
@@ -548,12 +1207,15 @@ mvt_image_file_open(const char *path, MvtImageFileMode mode)
 {
     MvtImageFile *fp;
     const char *mode_str;
+    struct stat st;
 
     if (!path)
         return NULL;
 
-    switch (mode) {
+    // Memory mappings are only used for reading
+    switch ((uint32_t)mode) {
     case MVT_IMAGE_FILE_MODE_READ:
+    case MVT_IMAGE_FILE_MODE_READ|MVT_IMAGE_FILE_MODE_MMAP:
         mode_str = "r";
         break;
     case MVT_IMAGE_FILE_MODE_WRITE:
@@ -571,7 +1233,25 @@ mvt_image_file_open(const char *path, MvtImageFileMode mode)
     fp->file = fopen(path, mode_str);
     if (!fp->file)
         goto error;
-    fp->mode = mode;
+    fp->mode = mode & ~MVT_IMAGE_FILE_MODE_MMAP;
+
+    fp->path = strdup(path);
+    if (!fp->path)
+        goto error;
+
+    // Record the file identity, e.g. to validate sidecar index files
+    if (fp->mode == MVT_IMAGE_FILE_MODE_READ &&
+        fstat(fileno(fp->file), &st) == 0 && S_ISREG(st.st_mode)) {
+        fp->file_size = st.st_size;
+        fp->file_mtime = st.st_mtim;
+    }
+
+    /* Fallback to buffered reads, e.g. from pipes, in which case frames
+       are copied into pooled images by mvt_image_file_map_image() */
+    if ((mode & MVT_IMAGE_FILE_MODE_MMAP) && !file_map(fp))
+        mvt_info("could not map `%s', using buffered reads", path);
+    if (fp->mode == MVT_IMAGE_FILE_MODE_READ && !fp->map)
+        setvbuf(fp->file, NULL, _IOFBF, READ_BUFFER_SIZE);
     mvt_image_info_init_defaults(&fp->info);
     return fp;
 
@@ -589,6 +1269,10 @@ mvt_image_file_close(MvtImageFile *fp)
 
     if (fp->file)
         fclose(fp->file);
+    file_mapping_unref(fp->map);
+    free(fp->frame_offsets);
+    free(fp->iov);
+    free(fp->path);
     free(fp);
 }
 
@@ -709,3 +1393,71 @@ mvt_image_file_read_image(MvtImageFile *fp, MvtImage *image)
     klass = fp->klass;
     return klass->read_image && klass->read_image(fp, image);
 }
+
+// Seeks to the supplied frame, so that it is the next one to be read
+bool
+mvt_image_file_seek(MvtImageFile *fp, uint32_t frame)
+{
+    const MvtImageFileClass *klass;
+
+    if (!fp || fp->mode != MVT_IMAGE_FILE_MODE_READ)
+        return false;
+
+    if (!fp->info_ready && !mvt_image_file_read_headers(fp, NULL))
+        return false;
+
+    klass = fp->klass;
+    return klass->seek && klass->seek(fp, frame);
+}
+
+// Reads the next image stored in file, as a view into the file if possible
+MvtImage *
+mvt_image_file_map_image(MvtImageFile *fp, MvtImagePool *pool)
+{
+    const MvtImageFileClass *klass;
+    MvtImage *image;
+
+    if (!fp || fp->mode != MVT_IMAGE_FILE_MODE_READ)
+        return NULL;
+
+    if (!fp->info_ready && !mvt_image_file_read_headers(fp, NULL))
+        return NULL;
+
+    klass = fp->klass;
+    if (fp->map && klass->map_image)
+        return klass->map_image(fp, pool);
+
+    image = mvt_image_pool_acquire(pool, fp->info.format, fp->info.width,
+        fp->info.height);
+    if (image && !mvt_image_file_read_image(fp, image))
+        mvt_image_pool_releasep(pool, &image);
+    return image;
+}
+
+// Determines whether frames can be read in any order
+bool
+mvt_image_file_is_seekable(MvtImageFile *fp)
+{
+    if (!fp || fp->mode != MVT_IMAGE_FILE_MODE_READ)
+        return false;
+
+    if (!fp->info_ready && !mvt_image_file_read_headers(fp, NULL))
+        return false;
+    return fp->is_seekable;
+}
+
+// Determines the number of frames stored in file
+uint32_t
+mvt_image_file_get_num_frames(MvtImageFile *fp)
+{
+    const MvtImageFileClass *klass;
+
+    if (!fp || fp->mode != MVT_IMAGE_FILE_MODE_READ)
+        return 0;
+
+    if (!fp->info_ready && !mvt_image_file_read_headers(fp, NULL))
+        return 0;
+
+    klass = fp->klass;
+    return klass->get_num_frames ? klass->get_num_frames(fp) : 0;
+}
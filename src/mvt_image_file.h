@@ -24,6 +24,7 @@
 #define MVT_IMAGE_FILE_H
 
 #include "mvt_image.h"
+#include "mvt_image_pool.h"
 
 MVT_BEGIN_DECLS
 
@@ -34,6 +35,7 @@ typedef struct MvtImageFile_s MvtImageFile;
 typedef enum {
     MVT_IMAGE_FILE_MODE_READ  = 1 << 0, ///< Read-only
     MVT_IMAGE_FILE_MODE_WRITE = 1 << 1, ///< Write-only
+    MVT_IMAGE_FILE_MODE_MMAP  = 1 << 2, ///< Read from a memory mapping
 } MvtImageFileMode;
 
 /** Image file info descriptor */
@@ -80,6 +82,71 @@ mvt_image_file_read_headers(MvtImageFile *fp, MvtImageInfo *info);
 bool
 mvt_image_file_read_image(MvtImageFile *fp, MvtImage *image);
 
+/**
+ * \brief Reads the next image stored in file, with no copy if possible.
+ *
+ * If the file was opened with \ref MVT_IMAGE_FILE_MODE_MMAP, the
+ * returned image is a view into the file mapping, which stays valid
+ * until the image is released, even past mvt_image_file_close(). Images
+ * that cannot be viewed in place, e.g. packed formats, or files that
+ * could not be mapped, are read into an image acquired from \ref pool.
+ *
+ * @param[in] fp                the image file, opened in read mode
+ * @param[in] pool              the pool of images to read into, or \c NULL
+ * @return the image, to be released with mvt_image_pool_release(), or
+ *   \c NULL if there is no more image to read
+ */
+MvtImage *
+mvt_image_file_map_image(MvtImageFile *fp, MvtImagePool *pool);
+
+/**
+ * \brief Seeks to the supplied frame.
+ *
+ * Positions the file so that the next call to
+ * mvt_image_file_read_image() returns the image at index \ref frame,
+ * counting from zero. Frames are located from the file headers and
+ * the frame size, or from an index of FRAME headers if they carry
+ * parameters. In either case, the skipped frame data is not read.
+ * On streams that cannot seek, e.g. pipes, this only succeeds for
+ * the next frame to be read, and does nothing.
+ *
+ * @param[in] fp                the image file, opened in read mode
+ * @param[in] frame             the index of the frame to seek to
+ * @return \c true on success, \c false if the frame does not exist
+ */
+bool
+mvt_image_file_seek(MvtImageFile *fp, uint32_t frame);
+
+/**
+ * \brief Determines whether frames can be read in any order.
+ *
+ * Regular files are seekable. Streams that cannot seek, e.g. pipes,
+ * can only be read in order, and mvt_image_file_seek() and
+ * mvt_image_file_get_num_frames() fail on them.
+ *
+ * @param[in] fp                the image file, opened in read mode
+ * @return \c true if mvt_image_file_seek() can be used
+ */
+bool
+mvt_image_file_is_seekable(MvtImageFile *fp);
+
+/**
+ * \brief Determines the number of frames stored in file.
+ *
+ * The number of frames is computed from the file size, unless FRAME
+ * headers carry parameters. In that case, all FRAME headers are
+ * indexed once, and the index is saved to a sidecar file named after
+ * the file with an ".idx" suffix. The sidecar file is reused by later
+ * calls to mvt_image_file_seek() as long as the file size and
+ * modification time still match. The current position is preserved.
+ * This fails on streams that cannot seek.
+ *
+ * @param[in] fp                the image file, opened in read mode
+ * @return the number of frames, or zero on error
+ */
+uint32_t
+mvt_image_file_get_num_frames(MvtImageFile *fp);
+
 MVT_END_DECLS
 
 #endif /* MVT_IMAGE_FILE_H */
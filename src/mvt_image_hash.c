@@ -24,16 +24,75 @@
 #include <wchar.h>
 #include "mvt_image.h"
 #include "mvt_image_priv.h"
+#include "mvt_image_simd.h"
 #include "mvt_memory.h"
 
-// Updates the checksum for the specified component
+/* Size of the chunks of samples gathered from interleaved components,
+   prior to hashing them */
+#define HASH_CHUNK_SIZE 4096
+
+// Gathers samples spaced by stride bytes into a contiguous buffer
+static void
+gather_samples_c(uint8_t *dst, const uint8_t *src, uint32_t n,
+    uint32_t stride, uint32_t offset, uint32_t bpc, uint32_t shift)
+{
+    uint32_t x;
+
+    src += offset;
+    if (bpc == 1) {
+        for (x = 0; x < n; x++)
+            dst[x] = src[x * stride];
+    }
+    else {
+        /* In MVT, high bit depth components are always stored in
+           native endian byte order */
+        uint16_t * const dst16 = (uint16_t *)dst;
+        for (x = 0; x < n; x++)
+            dst16[x] = *(const uint16_t *)&src[x * stride] >> shift;
+    }
+}
+
+#if USE_SSE2
+// Gathers 8-bit samples spaced by stride bytes (2 or 4) (SSE2 version)
+static void
+OPT_TARGET("sse2")
+gather_samples8_sse2(uint8_t *dst, const uint8_t *src, uint32_t n,
+    uint32_t stride, uint32_t offset)
+{
+    uint32_t x;
+
+    for (x = 0; x + 16 <= n; x += 16)
+        _mm_storeu_si128((__m128i *)&dst[x],
+            load_samples8(&src[x * stride], stride, offset));
+    gather_samples_c(&dst[x], &src[x * stride], n - x, stride, offset, 1, 0);
+}
+#endif
+
+// Gathers samples spaced by stride bytes into a contiguous buffer
+static void
+gather_samples(uint8_t *dst, const uint8_t *src, uint32_t n,
+    uint32_t stride, uint32_t offset, uint32_t bpc, uint32_t shift)
+{
+#if USE_SSE2
+    if (bpc == 1 && (stride == 2 || stride == 4) && offset < stride) {
+        gather_samples8_sse2(dst, src, n, stride, offset);
+        return;
+    }
+#endif
+    gather_samples_c(dst, src, n, stride, offset, bpc, shift);
+}
+
+/* Updates the checksum for the specified component. Interleaved or
+   MSB-aligned components are hashed in their planar form, i.e. samples
+   are gathered into chunks that are small enough to live on the stack */
 static void
 mvt_image_hash_component(MvtImage *image, MvtHash *hash,
     const VideoFormatInfo *vip, uint32_t component)
 {
     const VideoFormatComponentInfo * const cip = &vip->components[component];
+    uint8_t chunk[HASH_CHUNK_SIZE];
     const uint8_t *p;
-    uint32_t x, y, w, h, stride, bpc;
+    uint32_t x, y, w, h, n, stride, bpc;
 
     w = image->width;
     h = image->height;
@@ -45,17 +104,23 @@ mvt_image_hash_component(MvtImage *image, MvtHash *hash,
 
     bpc = (cip->bit_depth + 7) / 8; // bytes per component
 
-    p = get_component_ptr(image, cip, 0, 0);
-    if (cip->pixel_stride == bpc) {
+    if (cip->pixel_stride == bpc && cip->bit_shift == 0) {
+        p = get_component_ptr(image, cip, 0, 0);
         for (y = 0; y < h; y++) {
             mvt_hash_update(hash, p, w * bpc);
             p += stride;
         }
     }
     else {
+        p = &image->pixels[cip->plane][0];
         for (y = 0; y < h; y++) {
-            for (x = 0; x < w; x++)
-                mvt_hash_update(hash, p + x * cip->pixel_stride, bpc);
+            for (x = 0; x < w; x += n) {
+                n = MVT_MIN(w - x, sizeof(chunk) / bpc);
+                gather_samples(chunk, p + x * cip->pixel_stride, n,
+                    cip->pixel_stride, cip->pixel_offset, bpc,
+                    cip->bit_shift);
+                mvt_hash_update(hash, chunk, n * bpc);
+            }
             p += stride;
         }
     }
@@ -66,48 +131,46 @@ static bool
 mvt_image_hash_grayscale(MvtImage *image, MvtHash *hash,
     const VideoFormatInfo *vip)
 {
-    MvtImagePrivate * const priv = mvt_image_priv_ensure(image);
     const VideoFormatComponentInfo * const cip = &vip->components[0];
+    const MemScratchMark mark = mem_scratch_mark();
     uint32_t w, n, bpc, stride;
-    wchar_t c;
-
-    if (!priv)
-        return false;
+    wchar_t c, *chroma;
 
     w = (image->width + 1) / 2;
     bpc = (cip->bit_depth + 7) / 8;
     stride = round_up(w * bpc, sizeof(wchar_t));
 
-    if (!priv->hash_data || priv->hash_data_size < stride) {
-        if (!mem_reallocp(&priv->hash_data, &priv->hash_data_size, stride))
-            return false;
-
-        /* In MVT, high bit depth components are always stored in
-           native endian byte order */
+    /* In MVT, high bit depth components are always stored in
+       native endian byte order */
 #define INIT_CHROMA(bpc, type)                          \
-        case bpc: {                                     \
-            type * const p = (type *)&c;                \
-            int i;                                      \
-            for (i = 0; i < sizeof(c) / bpc; i++)       \
-                p[i] = 1U << (cip->bit_depth - 1);      \
-            break;                                      \
-        }
+    case bpc: {                                         \
+        type * const p = (type *)&c;                    \
+        int i;                                          \
+        for (i = 0; i < sizeof(c) / bpc; i++)           \
+            p[i] = 1U << (cip->bit_depth - 1);          \
+        break;                                          \
+    }
 
-        switch (bpc) {
-            INIT_CHROMA(1, uint8_t);
-            INIT_CHROMA(2, uint16_t);
-            INIT_CHROMA(4, uint32_t);
-        default: return false;
-        }
-#undef INIT_CHROMA
-        wmemset((wchar_t *)priv->hash_data, c, stride / sizeof(c));
+    switch (bpc) {
+        INIT_CHROMA(1, uint8_t);
+        INIT_CHROMA(2, uint16_t);
+        INIT_CHROMA(4, uint32_t);
+    default: return false;
     }
+#undef INIT_CHROMA
+
+    // The chroma row is a per-frame temporary from the scratch arena
+    chroma = mem_scratch_alloc(stride, sizeof(c));
+    if (!chroma)
+        return false;
+    wmemset(chroma, c, stride / sizeof(c));
 
     mvt_hash_init(hash);
     mvt_image_hash_component(image, hash, vip, 0);
     for (n = 2 * ((image->height + 1) / 2); n > 0; n--)
-        mvt_hash_update(hash, priv->hash_data, w * bpc);
+        mvt_hash_update(hash, (const uint8_t *)chroma, w * bpc);
     mvt_hash_finalize(hash);
+    mem_scratch_release(&mark);
     return true;
 }
 
@@ -140,3 +203,15 @@ error_unsupported_format:
               video_format_get_name(image->format));
     return false;
 }
+
+// Computes the checksum from the supplied MvtImage object, with flags
+bool
+mvt_image_hash_full(MvtImage *image, MvtHash *hash, uint32_t flags)
+{
+    if (!image || !hash)
+        return false;
+
+    if (flags & MVT_IMAGE_FLAG_FROM_USWC)
+        return mvt_image_hash_uswc(image, hash);
+    return mvt_image_hash(image, hash);
+}
@@ -0,0 +1,151 @@
+/*
+ * mvt_image_pool.c - Image pools
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#include "sysdeps.h"
+#include "mvt_image_pool.h"
+#include "mvt_image_priv.h"
+
+struct MvtImagePool_s {
+    MvtImage **images;          // Idle images, least recently released first
+    uint32_t num_images;
+    uint32_t max_images;
+    size_t size;                // Size of the data held by idle images
+    size_t max_size;
+};
+
+// Creates a new pool of images
+MvtImagePool *
+mvt_image_pool_new(size_t max_size)
+{
+    MvtImagePool *pool;
+
+    pool = calloc(1, sizeof(*pool));
+    if (!pool)
+        return NULL;
+
+    pool->max_size = max_size;
+    return pool;
+}
+
+// Deallocates MvtImagePool object and all the idle images from it
+void
+mvt_image_pool_free(MvtImagePool *pool)
+{
+    uint32_t i;
+
+    if (!pool)
+        return;
+
+    for (i = 0; i < pool->num_images; i++)
+        mvt_image_free(pool->images[i]);
+    free(pool->images);
+    free(pool);
+}
+
+// Frees the MvtImagePool object and reset the supplied pointer to NULL
+void
+mvt_image_pool_freep(MvtImagePool **pool_ptr)
+{
+    if (pool_ptr) {
+        mvt_image_pool_free(*pool_ptr);
+        *pool_ptr = NULL;
+    }
+}
+
+// Removes the idle image at the specified index from the pool
+static MvtImage *
+pool_remove(MvtImagePool *pool, uint32_t index)
+{
+    MvtImage * const image = pool->images[index];
+
+    memmove(&pool->images[index], &pool->images[index + 1],
+        (pool->num_images - index - 1) * sizeof(*pool->images));
+    pool->num_images--;
+    pool->size -= image->data_size;
+    return image;
+}
+
+// Acquires an image with the specified format and size
+MvtImage *
+mvt_image_pool_acquire(MvtImagePool *pool, VideoFormat format,
+    uint32_t width, uint32_t height)
+{
+    MvtImage *image;
+    uint32_t i;
+
+    if (!pool)
+        return mvt_image_new(format, width, height);
+
+    // Most recently released images are the most likely to be cache hot
+    for (i = pool->num_images; i-- > 0;) {
+        image = pool->images[i];
+        if (image->format == format && image->width == width &&
+            image->height == height)
+            return pool_remove(pool, i);
+    }
+    return mvt_image_new(format, width, height);
+}
+
+// Releases the image back to the pool, or unrefs it if pool is NULL
+void
+mvt_image_pool_release(MvtImagePool *pool, MvtImage *image)
+{
+    if (!image)
+        return;
+
+    // Only keep images that own their data, and that nobody else uses
+    if (!pool || !image->data || image->data_size > pool->max_size ||
+        image->priv->ref_count > 1)
+        goto error_free_image;
+
+    if (pool->num_images == pool->max_images) {
+        const uint32_t max_images = MVT_MAX(pool->max_images * 2, 4);
+        MvtImage ** const images = realloc(pool->images,
+            max_images * sizeof(*images));
+        if (!images)
+            goto error_free_image;
+        pool->images = images;
+        pool->max_images = max_images;
+    }
+
+    // Evict the least recently released images until the new one fits
+    while (pool->num_images > 0 &&
+           pool->size + image->data_size > pool->max_size)
+        mvt_image_free(pool_remove(pool, 0));
+
+    pool->images[pool->num_images++] = image;
+    pool->size += image->data_size;
+    return;
+
+error_free_image:
+    mvt_image_unref(image);
+}
+
+// Releases the image back to the pool and reset the supplied pointer
+void
+mvt_image_pool_releasep(MvtImagePool *pool, MvtImage **image_ptr)
+{
+    if (image_ptr) {
+        mvt_image_pool_release(pool, *image_ptr);
+        *image_ptr = NULL;
+    }
+}
@@ -0,0 +1,75 @@
+/*
+ * mvt_image_pool.h - Image pools
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#ifndef MVT_IMAGE_POOL_H
+#define MVT_IMAGE_POOL_H
+
+#include "mvt_image.h"
+
+MVT_BEGIN_DECLS
+
+struct MvtImagePool_s;
+typedef struct MvtImagePool_s MvtImagePool;
+
+/** Default max size of the data held by idle images in a pool */
+#define MVT_IMAGE_POOL_DEFAULT_MAX_SIZE (256U << 20)
+
+/**
+ * \brief Creates a new pool of images.
+ *
+ * Released images are kept for reuse by a later acquisition with the
+ * same format and size. The least recently released images are evicted
+ * once their data exceeds \ref max_size bytes.
+ */
+MvtImagePool *
+mvt_image_pool_new(size_t max_size);
+
+/** Deallocates MvtImagePool object and all the idle images from it */
+void
+mvt_image_pool_free(MvtImagePool *pool);
+
+/** Frees the MvtImagePool object and reset the supplied pointer to NULL */
+void
+mvt_image_pool_freep(MvtImagePool **pool_ptr);
+
+/**
+ * \brief Acquires an image with the specified format and size.
+ *
+ * The image is reused from the pool if possible, and its contents are
+ * then undefined. A new image is allocated otherwise, or if \ref pool is
+ * \c NULL.
+ */
+MvtImage *
+mvt_image_pool_acquire(MvtImagePool *pool, VideoFormat format,
+    uint32_t width, uint32_t height);
+
+/** Releases the image back to the pool, or unrefs it if pool is NULL */
+void
+mvt_image_pool_release(MvtImagePool *pool, MvtImage *image);
+
+/** Releases the image back to the pool and reset the supplied pointer */
+void
+mvt_image_pool_releasep(MvtImagePool *pool, MvtImage **image_ptr);
+
+MVT_END_DECLS
+
+#endif /* MVT_IMAGE_POOL_H */
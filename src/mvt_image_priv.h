@@ -26,10 +26,10 @@
 // Private image data
 struct MvtImagePrivate_s {
     uint8_t *           data_base;      ///< Base memory buffer (allocated)
-    uint8_t *           copy_cache;     ///< Cache buffer used for image copies
-    uint32_t            copy_cache_size; ///< Size of the cache buffer
-    uint8_t *           hash_data;      ///< Private hash data
-    uint32_t            hash_data_size; ///< Size of the private hash data
+    size_t              data_base_size; ///< Size of data_base, if huge pages
+    uint32_t            ref_count;      ///< Reference count (heap images)
+    MvtImageReleaseFunc release_func;   ///< Releases the wrapped pixels
+    void *              release_data;   ///< User data for release_func
 };
 
 // Ensures private image data is allocated
@@ -37,6 +37,11 @@ DLL_HIDDEN
 MvtImagePrivate *
 mvt_image_priv_ensure(MvtImage *image);
 
+// Computes the checksum of an NV12 or I420 image in USWC memory
+DLL_HIDDEN
+bool
+mvt_image_hash_uswc(MvtImage *image, MvtHash *hash);
+
 // Round up the supplied value. Alignment must be a power of two
 static inline uint32_t
 round_up(uint32_t v, uint32_t a)
@@ -76,7 +81,7 @@ get_component16(MvtImage *image, const VideoFormatComponentInfo *cip,
 {
     const uint16_t * const p = (uint16_t *)get_component_ptr(image, cip, x, y);
 
-    return *p & ((1U << cip->bit_depth) - 1);
+    return (*p >> cip->bit_shift) & ((1U << cip->bit_depth) - 1);
 }
 
 // Put 16-bit component to the specified coordinates
@@ -86,7 +91,7 @@ put_component16(MvtImage *image, const VideoFormatComponentInfo *cip,
 {
     uint16_t * const p = get_component_ptr(image, cip, x, y);
 
-    *p = v & ((1U << cip->bit_depth) - 1);
+    *p = (v & ((1U << cip->bit_depth) - 1)) << cip->bit_shift;
 }
 
 // Get component value at the specified coordinates
@@ -0,0 +1,71 @@
+/*
+ * mvt_image_simd.h - Image utilities (SIMD helpers, private)
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#ifndef MVT_IMAGE_SIMD_H
+#define MVT_IMAGE_SIMD_H
+
+/* Check whether SSE2 optimizations could be used */
+#if defined(__x86_64__) || (defined(__i386__) && HAVE_OPT_TARGET)
+# define USE_SSE2 1
+# include <emmintrin.h>
+#else
+# define USE_SSE2 0
+#endif
+
+#if USE_SSE2
+/* Loads 16 8-bit samples spaced by stride bytes (1, 2 or 4), and located
+   at offset within each pixel unit. Loads are performed from the start of
+   the pixel units, so that the last unit of a row is never read past */
+static inline __m128i
+MVT_ALWAYS_INLINE
+OPT_TARGET("sse2")
+load_samples8(const uint8_t *p, uint32_t stride, uint32_t offset)
+{
+    const __m128i shift = _mm_cvtsi32_si128(8 * offset);
+    __m128i v0, v1, v2, v3, m;
+
+    switch (stride) {
+    case 2:
+        m = _mm_set1_epi16(0xff);
+        v0 = _mm_loadu_si128((const __m128i *)p);
+        v1 = _mm_loadu_si128((const __m128i *)(p + 16));
+        v0 = _mm_and_si128(_mm_srl_epi16(v0, shift), m);
+        v1 = _mm_and_si128(_mm_srl_epi16(v1, shift), m);
+        return _mm_packus_epi16(v0, v1);
+    case 4:
+        m = _mm_set1_epi32(0xff);
+        v0 = _mm_loadu_si128((const __m128i *)p);
+        v1 = _mm_loadu_si128((const __m128i *)(p + 16));
+        v2 = _mm_loadu_si128((const __m128i *)(p + 32));
+        v3 = _mm_loadu_si128((const __m128i *)(p + 48));
+        v0 = _mm_and_si128(_mm_srl_epi32(v0, shift), m);
+        v1 = _mm_and_si128(_mm_srl_epi32(v1, shift), m);
+        v2 = _mm_and_si128(_mm_srl_epi32(v2, shift), m);
+        v3 = _mm_and_si128(_mm_srl_epi32(v3, shift), m);
+        return _mm_packus_epi16(_mm_packs_epi32(v0, v1),
+            _mm_packs_epi32(v2, v3));
+    }
+    return _mm_loadu_si128((const __m128i *)p);
+}
+#endif
+
+#endif /* MVT_IMAGE_SIMD_H */
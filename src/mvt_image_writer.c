@@ -0,0 +1,258 @@
+/*
+ * mvt_image_writer.c - Asynchronous image writer
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#include "sysdeps.h"
+#include <pthread.h>
+#include "mvt_image_writer.h"
+#include "mvt_image_pool.h"
+#include "mvt_image_priv.h"
+
+struct MvtImageWriter_s {
+    MvtImageFile *file;
+    MvtImagePool *pool;         // Pool for copied images (producer thread)
+    pthread_t thread;
+    pthread_mutex_t lock;       // Lock for the fields below
+    pthread_cond_t push_cond;   // Signaled when an image is queued
+    pthread_cond_t pop_cond;    // Signaled when an image was written
+    MvtImage **queue;           // Ring of images to write
+    uint32_t queue_depth;
+    uint32_t queue_head;
+    uint32_t queue_count;
+    MvtImage **done;            // Written images, to recycle in push()
+    uint32_t num_done;
+    bool is_running;
+    bool has_error;
+};
+
+// Writes the queued images until the writer is stopped
+static void *
+writer_thread(void *arg)
+{
+    MvtImageWriter * const writer = arg;
+    MvtImage *image;
+    bool discard, success;
+
+    pthread_mutex_lock(&writer->lock);
+    for (;;) {
+        while (writer->queue_count == 0 && writer->is_running)
+            pthread_cond_wait(&writer->push_cond, &writer->lock);
+        if (writer->queue_count == 0)
+            break;
+
+        // Keep draining on error, so that push() never blocks forever
+        image = writer->queue[writer->queue_head];
+        discard = writer->has_error;
+        pthread_mutex_unlock(&writer->lock);
+
+        success = discard || mvt_image_file_write_image(writer->file, image);
+
+        pthread_mutex_lock(&writer->lock);
+        if (!success)
+            writer->has_error = true;
+        writer->queue_head = (writer->queue_head + 1) % writer->queue_depth;
+        writer->queue_count--;
+        writer->done[writer->num_done++] = image;
+        pthread_cond_signal(&writer->pop_cond);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+// Creates a new writer of images to the supplied file
+MvtImageWriter *
+mvt_image_writer_new(MvtImageFile *file, uint32_t queue_depth)
+{
+    MvtImageWriter *writer;
+
+    if (!file || queue_depth == 0)
+        return NULL;
+
+    writer = calloc(1, sizeof(*writer));
+    if (!writer)
+        return NULL;
+
+    writer->file = file;
+    writer->queue_depth = queue_depth;
+    writer->queue = calloc(queue_depth, sizeof(*writer->queue));
+    writer->done = calloc(queue_depth, sizeof(*writer->done));
+    if (!writer->queue || !writer->done)
+        goto error_alloc_memory;
+
+    writer->pool = mvt_image_pool_new(MVT_IMAGE_POOL_DEFAULT_MAX_SIZE);
+    if (!writer->pool)
+        goto error_alloc_memory;
+
+    if (pthread_mutex_init(&writer->lock, NULL) != 0)
+        goto error_init_lock;
+    if (pthread_cond_init(&writer->push_cond, NULL) != 0)
+        goto error_init_push_cond;
+    if (pthread_cond_init(&writer->pop_cond, NULL) != 0)
+        goto error_init_pop_cond;
+
+    writer->is_running = true;
+    if (pthread_create(&writer->thread, NULL, writer_thread, writer) != 0)
+        goto error_create_thread;
+    return writer;
+
+    /* ERRORS */
+error_alloc_memory:
+    mvt_error("failed to allocate memory for the image writer");
+    goto error_cleanup;
+error_create_thread:
+    pthread_cond_destroy(&writer->pop_cond);
+error_init_pop_cond:
+    pthread_cond_destroy(&writer->push_cond);
+error_init_push_cond:
+    pthread_mutex_destroy(&writer->lock);
+error_init_lock:
+    mvt_error("failed to create image writer thread");
+error_cleanup:
+    mvt_image_pool_free(writer->pool);
+    free(writer->done);
+    free(writer->queue);
+    free(writer);
+    return NULL;
+}
+
+// Recycles the written images (producer thread, writer lock held)
+static void
+writer_recycle(MvtImageWriter *writer)
+{
+    uint32_t i;
+
+    for (i = 0; i < writer->num_done; i++)
+        mvt_image_pool_release(writer->pool, writer->done[i]);
+    writer->num_done = 0;
+}
+
+// Stops the writer thread, once all the queued images are written
+static void
+writer_stop(MvtImageWriter *writer)
+{
+    if (!writer->is_running)
+        return;
+
+    pthread_mutex_lock(&writer->lock);
+    writer->is_running = false;
+    pthread_cond_signal(&writer->push_cond);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+}
+
+// Deallocates MvtImageWriter object, discarding the pending images
+void
+mvt_image_writer_free(MvtImageWriter *writer)
+{
+    if (!writer)
+        return;
+
+    if (writer->is_running) {
+        pthread_mutex_lock(&writer->lock);
+        writer->has_error = true; // discard pending images
+        pthread_mutex_unlock(&writer->lock);
+        writer_stop(writer);
+    }
+    writer_recycle(writer);
+    pthread_cond_destroy(&writer->pop_cond);
+    pthread_cond_destroy(&writer->push_cond);
+    pthread_mutex_destroy(&writer->lock);
+    mvt_image_pool_free(writer->pool);
+    free(writer->done);
+    free(writer->queue);
+    free(writer);
+}
+
+// Returns an image the writer thread can own until it is written
+static MvtImage *
+writer_own_image(MvtImageWriter *writer, MvtImage *src_image)
+{
+    MvtImage *image;
+
+    // Wrapped decoder frames are immutable until released
+    if (src_image->priv && src_image->priv->release_func)
+        return mvt_image_ref(src_image);
+
+    image = mvt_image_pool_acquire(writer->pool, src_image->format,
+        src_image->width, src_image->height);
+    if (!image)
+        return NULL;
+    if (!mvt_image_convert(image, src_image)) {
+        mvt_image_pool_release(writer->pool, image);
+        return NULL;
+    }
+    return image;
+}
+
+// Pushes an image to write
+bool
+mvt_image_writer_push(MvtImageWriter *writer, MvtImage *src_image)
+{
+    MvtImage *image;
+    uint32_t index;
+
+    if (!writer || !src_image || !writer->is_running)
+        return false;
+
+    // Copy before waiting, so that it overlaps with the pending writes
+    pthread_mutex_lock(&writer->lock);
+    writer_recycle(writer);
+    pthread_mutex_unlock(&writer->lock);
+
+    image = writer_own_image(writer, src_image);
+    if (!image)
+        goto error_own_image;
+
+    pthread_mutex_lock(&writer->lock);
+    while (writer->queue_count == writer->queue_depth)
+        pthread_cond_wait(&writer->pop_cond, &writer->lock);
+    writer_recycle(writer); // queued and done images fit in queue_depth
+    if (writer->has_error)
+        goto error_write_image;
+    index = (writer->queue_head + writer->queue_count) % writer->queue_depth;
+    writer->queue[index] = image;
+    writer->queue_count++;
+    pthread_cond_signal(&writer->push_cond);
+    pthread_mutex_unlock(&writer->lock);
+    return true;
+
+    /* ERRORS */
+error_own_image:
+    mvt_error("failed to copy image to write");
+    return false;
+error_write_image:
+    pthread_mutex_unlock(&writer->lock);
+    mvt_image_pool_release(writer->pool, image);
+    mvt_error("failed to write image");
+    return false;
+}
+
+// Waits for all the pending images to be written
+bool
+mvt_image_writer_finish(MvtImageWriter *writer)
+{
+    if (!writer)
+        return false;
+
+    writer_stop(writer);
+    writer_recycle(writer);
+    return !writer->has_error;
+}
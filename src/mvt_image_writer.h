@@ -0,0 +1,70 @@
+/*
+ * mvt_image_writer.h - Asynchronous image writer
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#ifndef MVT_IMAGE_WRITER_H
+#define MVT_IMAGE_WRITER_H
+
+#include "mvt_image_file.h"
+
+MVT_BEGIN_DECLS
+
+struct MvtImageWriter_s;
+typedef struct MvtImageWriter_s MvtImageWriter;
+
+/**
+ * \brief Creates a new writer of images to the supplied file.
+ *
+ * Images are written by a dedicated thread, from a queue of at most the
+ * supplied number of images. The file headers shall be written before
+ * the first image is pushed, and the file shall not be accessed by the
+ * caller until mvt_image_writer_finish() is called.
+ */
+MvtImageWriter *
+mvt_image_writer_new(MvtImageFile *file, uint32_t queue_depth);
+
+/** Deallocates MvtImageWriter object, discarding the pending images */
+void
+mvt_image_writer_free(MvtImageWriter *writer);
+
+/**
+ * \brief Pushes an image to write.
+ *
+ * Images wrapping decoder frames, i.e. created with
+ * mvt_image_new_wrapped(), are referenced. Other images are copied,
+ * since their owner may reuse them. This blocks while the queue is full.
+ *
+ * @return \c false if a previous image could not be written
+ */
+bool
+mvt_image_writer_push(MvtImageWriter *writer, MvtImage *image);
+
+/**
+ * \brief Waits for all the pending images to be written.
+ *
+ * @return \c false if any image could not be written
+ */
+bool
+mvt_image_writer_finish(MvtImageWriter *writer);
+
+MVT_END_DECLS
+
+#endif /* MVT_IMAGE_WRITER_H */
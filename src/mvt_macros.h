@@ -34,6 +34,10 @@
 #define MVT_ALIGNED(n)                  __attribute__((__aligned__(n)))
 #endif
 
+#ifndef MVT_ALWAYS_INLINE
+#define MVT_ALWAYS_INLINE               __attribute__((__always_inline__))
+#endif
+
 #if defined __GNUC__
 # define MVT_LIKELY(expr)               (__builtin_expect(!!(expr), 1))
 # define MVT_UNLIKELY(expr)             (__builtin_expect(!!(expr), 0))
@@ -21,21 +21,198 @@
  */
 
 #include "sysdeps.h"
+#include <sys/mman.h>
 #include "mvt_memory.h"
 
 #undef mem_reallocp
 
+// Minimal size of the scratch arena blocks
+#define SCRATCH_BLOCK_SIZE (64U << 10)
+
+// Alignment of the scratch arena blocks, i.e. a cache line
+#define SCRATCH_BLOCK_ALIGN (64)
+
+// Scratch arena of a thread
+typedef struct {
+    uint8_t *block;             // Bump allocated block
+    size_t block_size;
+    size_t offset;              // Current offset into the block
+    size_t size;                // Size in use, including overflows
+    size_t peak_size;           // Peak size in use, since the last growth
+    void **overflows;           // Allocations that did not fit the block
+    uint32_t num_overflows;
+    uint32_t max_overflows;
+} ScratchArena;
+
+static __thread ScratchArena g_scratch;
+
+static uint64_t g_num_allocs;
+
+// Counts one heap allocation
+static inline void
+count_alloc(void)
+{
+    __sync_add_and_fetch(&g_num_allocs, 1);
+}
+
+// Returns the number of heap allocations made so far
+uint64_t
+mem_get_num_allocs(void)
+{
+    return __sync_add_and_fetch(&g_num_allocs, 0);
+}
+
+// Allocates memory, and counts the allocation
+void *
+mem_alloc(size_t size)
+{
+    count_alloc();
+    return malloc(size);
+}
+
+// Allocates zero-initialized memory for an array of nmemb elements
+void *
+mem_calloc(size_t nmemb, size_t size)
+{
+    count_alloc();
+    return calloc(nmemb, size);
+}
+
 // Allocates memory aligned on bounardy specified by alignment
 void *
 mem_alloc_aligned(size_t size, size_t alignment)
 {
     void *mem;
 
+    count_alloc();
     if (posix_memalign(&mem, alignment, size) == 0)
         return mem;
     return NULL;
 }
 
+// Allocates temporary memory from the scratch arena of the thread
+void *
+mem_scratch_alloc(size_t size, size_t alignment)
+{
+    ScratchArena * const arena = &g_scratch;
+    const size_t offset = (arena->offset + alignment - 1) & ~(alignment - 1);
+    void *mem;
+
+    if (alignment <= SCRATCH_BLOCK_ALIGN && arena->block &&
+        offset + size <= arena->block_size) {
+        arena->size += offset + size - arena->offset;
+        arena->offset = offset + size;
+        mem = arena->block + offset;
+        goto done;
+    }
+
+    if (arena->num_overflows == arena->max_overflows) {
+        const uint32_t max_overflows = MVT_MAX(arena->max_overflows * 2, 8);
+        void ** const overflows = realloc(arena->overflows,
+            max_overflows * sizeof(*overflows));
+        count_alloc();
+        if (!overflows)
+            return NULL;
+        arena->overflows = overflows;
+        arena->max_overflows = max_overflows;
+    }
+
+    mem = mem_alloc_aligned(size, MVT_MAX(alignment, sizeof(void *)));
+    if (!mem)
+        return NULL;
+    arena->overflows[arena->num_overflows++] = mem;
+    arena->size += size + alignment;
+
+done:
+    if (arena->peak_size < arena->size)
+        arena->peak_size = arena->size;
+    return mem;
+}
+
+// Returns the current position in the scratch arena of the thread
+MemScratchMark
+mem_scratch_mark(void)
+{
+    MemScratchMark mark;
+
+    mark.offset = g_scratch.offset;
+    mark.num_overflows = g_scratch.num_overflows;
+    return mark;
+}
+
+// Releases the scratch memory allocated since the supplied mark
+void
+mem_scratch_release(const MemScratchMark *mark)
+{
+    ScratchArena * const arena = &g_scratch;
+
+    mvt_return_if_fail(mark != NULL);
+
+    while (arena->num_overflows > mark->num_overflows)
+        free(arena->overflows[--arena->num_overflows]);
+    arena->offset = mark->offset;
+    if (arena->offset > 0 || arena->num_overflows > 0)
+        return;
+
+    // Grow the block to the peak usage, once nothing is live any more
+    arena->size = 0;
+    if (arena->peak_size > arena->block_size) {
+        const size_t block_size = MVT_MAX(SCRATCH_BLOCK_SIZE,
+            (arena->peak_size + SCRATCH_BLOCK_SIZE - 1) &
+            ~(size_t)(SCRATCH_BLOCK_SIZE - 1));
+
+        free(arena->block);
+        arena->block = mem_alloc_aligned(block_size, SCRATCH_BLOCK_ALIGN);
+        arena->block_size = arena->block ? block_size : 0;
+    }
+    arena->peak_size = 0;
+}
+
+// Allocates memory backed by huge pages
+void *
+mem_alloc_huge(size_t size, size_t *size_ptr)
+{
+    void *mem;
+
+    size = (size + MEM_HUGE_PAGE_SIZE - 1) & ~(size_t)(MEM_HUGE_PAGE_SIZE - 1);
+    count_alloc();
+
+#ifdef MAP_HUGETLB
+    mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mem != MAP_FAILED) {
+        mvt_info("allocated %zu bytes from huge pages", size);
+        goto done;
+    }
+#endif
+
+    mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        return NULL;
+
+#ifdef MADV_HUGEPAGE
+    if (madvise(mem, size, MADV_HUGEPAGE) == 0)
+        mvt_info("allocated %zu bytes from transparent huge pages", size);
+    else
+#endif
+        mvt_info("allocated %zu bytes from regular pages, huge pages are "
+            "not available", size);
+
+done:
+    if (size_ptr)
+        *size_ptr = size;
+    return mem;
+}
+
+// Deallocates memory allocated with mem_alloc_huge()
+void
+mem_free_huge(void *mem, size_t size)
+{
+    if (mem)
+        munmap(mem, size);
+}
+
 // Reallocates memory to the expected size
 static bool
 mem_reallocp(void *mem_arg, size_t *size_ptr, size_t new_size)
@@ -46,6 +223,7 @@ mem_reallocp(void *mem_arg, size_t *size_ptr, size_t new_size)
     if (!mem_ptr)
         return false;
 
+    count_alloc();
     new_mem = realloc(*mem_ptr, new_size);
     if (!new_mem)
         return false;
@@ -97,6 +275,7 @@ mem_dup(const void *mem, size_t size)
     if (!mem || size == 0)
         return NULL;
 
+    count_alloc();
     new_mem = malloc(size);
     if (!new_mem)
         return NULL;
@@ -25,6 +25,14 @@
 
 MVT_BEGIN_DECLS
 
+/** Allocates memory, and counts the allocation (see mem_get_num_allocs()) */
+void *
+mem_alloc(size_t size);
+
+/** Allocates zero-initialized memory for an array of nmemb elements */
+void *
+mem_calloc(size_t nmemb, size_t size);
+
 /**
  * \brief Allocates memory aligned on bounardy specified by alignment
  *
@@ -39,6 +47,70 @@ MVT_BEGIN_DECLS
 void *
 mem_alloc_aligned(size_t size, size_t alignment);
 
+/** Size of the huge pages, i.e. 2 MB on x86 */
+#define MEM_HUGE_PAGE_SIZE (2U << 20)
+
+/**
+ * \brief Allocates memory backed by huge pages
+ *
+ * Allocates at least \c size bytes, rounded up to a multiple of \ref
+ * MEM_HUGE_PAGE_SIZE, from explicit huge pages (MAP_HUGETLB) if there
+ * are any available. Otherwise, regular pages are allocated and the
+ * kernel is advised to back them with transparent huge pages. The block
+ * shall be deallocated with mem_free_huge().
+ *
+ * @param[in] size              the minimum size in bytes of the resulting block
+ * @param[out] size_ptr         the size in bytes of the allocated block
+ * @return the newly allocated memory, or \c NULL on error
+ */
+void *
+mem_alloc_huge(size_t size, size_t *size_ptr);
+
+/** Deallocates memory allocated with mem_alloc_huge() */
+void
+mem_free_huge(void *mem, size_t size);
+
+/** Position in the scratch arena of the calling thread */
+typedef struct {
+    size_t offset;              ///< Offset into the arena block
+    uint32_t num_overflows;     ///< Number of allocations out of the block
+} MemScratchMark;
+
+/**
+ * \brief Allocates temporary memory from the scratch arena of the thread
+ *
+ * Scratch memory is bump allocated from a per-thread block, and it is
+ * only valid until mem_scratch_release() is called with a mark taken
+ * before the allocation. Requests that do not fit into the block are
+ * served from the heap, and the block is grown to the peak usage once
+ * the arena is released entirely. In steady state, e.g. for the same
+ * temporaries on each frame, this makes no heap allocation.
+ *
+ * @param[in] size              the minimum size in bytes of the resulting block
+ * @param[in] alignment         the required memory alignment (power-of-two)
+ * @return the scratch memory, or \c NULL on error
+ */
+void *
+mem_scratch_alloc(size_t size, size_t alignment);
+
+/** Returns the current position in the scratch arena of the thread */
+MemScratchMark
+mem_scratch_mark(void);
+
+/** Releases the scratch memory allocated since the supplied mark */
+void
+mem_scratch_release(const MemScratchMark *mark);
+
+/**
+ * \brief Returns the number of heap allocations made so far
+ *
+ * This counts the allocations from all the threads made with the
+ * mem_*() functions, including the ones for scratch arenas. This is
+ * meant to check that the hot paths do not allocate in steady state.
+ */
+uint64_t
+mem_get_num_allocs(void);
+
 /**
  * \brief Reallocates memory to the expected size
  *
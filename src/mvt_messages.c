@@ -38,6 +38,27 @@ NAME(const char *format, ...)                           \
     CODE;                                               \
 }
 
+// Informational messages are only printed if MVT_VERBOSE is set
+void
+mvt_info(const char *format, ...)
+{
+    static int verbose = -1;
+    va_list args;
+
+    if (verbose < 0) {
+        const char * const str = getenv("MVT_VERBOSE");
+        verbose = str && *str && strcmp(str, "0") != 0;
+    }
+    if (!verbose)
+        return;
+
+    fprintf(stderr, "info: ");
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+}
+
 DEFINE_LOGGER(mvt_warning,      "warning",      stdout, )
 DEFINE_LOGGER(mvt_error,        "error",        stderr, )
 DEFINE_LOGGER(mvt_fatal_error,  "fatal error",  stderr, exit(1))
@@ -23,6 +23,9 @@
 #ifndef MVT_MESSAGES_H
 #define MVT_MESSAGES_H
 
+void
+mvt_info(const char *format, ...);
+
 void
 mvt_warning(const char *format, ...);
 
@@ -0,0 +1,176 @@
+/*
+ * mvt_numa.c - NUMA placement
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1 /* sched_setaffinity() */
+#endif
+#include "sysdeps.h"
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "mvt_numa.h"
+
+// Preferred node memory policy, from <linux/mempolicy.h>
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+// Max size of a CPU list string
+#define CPU_LIST_SIZE 256
+
+// Parses a CPU list string, e.g. "0-3,8,10-11"
+static bool
+parse_cpu_list(const char *str, cpu_set_t *cpus)
+{
+    unsigned long first, last;
+    char *end;
+
+    CPU_ZERO(cpus);
+    do {
+        first = strtoul(str, &end, 10);
+        if (end == str)
+            return false;
+        last = first;
+        if (*end == '-') {
+            str = end + 1;
+            last = strtoul(str, &end, 10);
+            if (end == str || last < first)
+                return false;
+        }
+        if (last >= CPU_SETSIZE)
+            return false;
+        for (; first <= last; first++)
+            CPU_SET(first, cpus);
+        str = end + 1;
+    } while (*end == ',');
+    return *end == '\0' || *end == '\n' || *end == ';';
+}
+
+/* Retrieves the CPU list string of the supplied node, either simulated
+   through MVT_NUMA_NODES or read from sysfs */
+static bool
+get_node_cpu_list(unsigned node, char *buf, size_t size, bool *simulated)
+{
+    const char *str = getenv("MVT_NUMA_NODES");
+    char path[64];
+    size_t len;
+    FILE *fp;
+
+    *simulated = str != NULL;
+    if (str) {
+        for (; node > 0; node--) {
+            str = strchr(str, ';');
+            if (!str)
+                return false;
+            str++;
+        }
+        len = strcspn(str, ";");
+        if (len == 0 || len >= size)
+            return false;
+        memcpy(buf, str, len);
+        buf[len] = '\0';
+        return true;
+    }
+
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist",
+        node);
+    fp = fopen(path, "r");
+    if (!fp)
+        return false;
+    str = fgets(buf, size, fp);
+    fclose(fp);
+    if (!str)
+        return false;
+    buf[strcspn(buf, "\n")] = '\0';
+    return true;
+}
+
+// Prefers memory from the supplied node for the calling thread
+static bool
+set_preferred_node(unsigned node)
+{
+    unsigned long mask[4] = { 0, };
+    const unsigned bits = 8 * sizeof(mask[0]);
+
+    if (node >= bits * MVT_ARRAY_LENGTH(mask))
+        return false;
+    mask[node / bits] = 1UL << (node % bits);
+
+#ifdef SYS_set_mempolicy
+    return syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask,
+        bits * MVT_ARRAY_LENGTH(mask) + 1) == 0;
+#else
+    return false;
+#endif
+}
+
+// Applies a NUMA placement policy to the calling thread
+bool
+mvt_numa_apply_policy(const char *policy)
+{
+    char cpu_list[CPU_LIST_SIZE];
+    const char *memory = "first touch";
+    cpu_set_t cpus;
+    unsigned long node;
+    bool simulated = false;
+    char *end;
+
+    if (strncmp(policy, "node:", 5) == 0) {
+        node = strtoul(policy + 5, &end, 10);
+        if (end == policy + 5 || *end != '\0')
+            goto error_invalid_policy;
+        if (!get_node_cpu_list(node, cpu_list, sizeof(cpu_list), &simulated))
+            goto error_invalid_node;
+        if (!simulated && set_preferred_node(node))
+            memory = "preferred node";
+    }
+    else if (strncmp(policy, "cpus:", 5) == 0) {
+        if (strlen(policy + 5) >= sizeof(cpu_list))
+            goto error_invalid_policy;
+        strcpy(cpu_list, policy + 5);
+    }
+    else
+        goto error_invalid_policy;
+
+    if (!parse_cpu_list(cpu_list, &cpus))
+        goto error_invalid_cpu_list;
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0)
+        goto error_set_affinity;
+
+    mvt_info("numa: %s: pinned to cpus %s%s, memory from %s", policy,
+        cpu_list, simulated ? " (simulated node)" : "", memory);
+    return true;
+
+    /* ERRORS */
+error_invalid_policy:
+    mvt_error("invalid NUMA policy '%s'", policy);
+    return false;
+error_invalid_node:
+    mvt_error("failed to determine the CPUs of NUMA node %lu", node);
+    return false;
+error_invalid_cpu_list:
+    mvt_error("invalid CPU list '%s'", cpu_list);
+    return false;
+error_set_affinity:
+    mvt_error("failed to set CPU affinity to '%s'", cpu_list);
+    return false;
+}
@@ -0,0 +1,53 @@
+/*
+ * mvt_numa.h - NUMA placement
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#ifndef MVT_NUMA_H
+#define MVT_NUMA_H
+
+MVT_BEGIN_DECLS
+
+/**
+ * \brief Applies a NUMA placement policy to the calling thread.
+ *
+ * The \ref policy string is either "node:N", to run on the CPUs of the
+ * NUMA node N and to allocate memory from that node, or "cpus:LIST", to
+ * run on the CPUs of the supplied list, e.g. "0-3,8". Memory is then
+ * allocated on first touch, i.e. from the node of the CPU that first
+ * writes to it.
+ *
+ * The calling thread is pinned to those CPUs, and so are the threads it
+ * creates afterwards, e.g. the decoder and copy worker threads. So, this
+ * function shall be called early, before any thread or image is created.
+ *
+ * The CPU lists of the nodes are read from sysfs, unless MVT_NUMA_NODES
+ * is set in the environment, e.g. "0-1;2-3" to simulate two nodes with
+ * two CPUs each. Memory is always allocated on first touch in that case.
+ *
+ * @param[in] policy    the NUMA policy string
+ * @return \c true on success
+ */
+bool
+mvt_numa_apply_policy(const char *policy);
+
+MVT_END_DECLS
+
+#endif /* MVT_NUMA_H */
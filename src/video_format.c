@@ -82,6 +82,8 @@
 #define C_BGRA          1, 4, {{0,2,4,8},{0,1,4,8},{0,0,4,8},{0,3,4}}
 #define C_BGRx          1, 3, {{0,2,4,8},{0,1,4,8},{0,0,4,8},}
 #define C_YUVp(n)       3, 3, {{0,0,2,n},{1,0,2,n},{2,0,2,n},}
+#define C_P010          2, 3, {{0,0,2,10,6},{1,0,4,10,6},{1,2,4,10,6},}
+#define C_P016          2, 3, {{0,0,2,16},{1,0,4,16},{1,2,4,16},}
 
 #ifdef WORDS_BIGENDIAN
 #define VA_NSB_FIRST VA_MSB_FIRST
@@ -132,9 +134,9 @@ static const VideoFormatInfo g_video_formats[] = {
     DEF_RGB(BGRA, ('A','R','G','B'), LSB, 32,
             32, 0x0000ff00, 0x00ff0000, 0xff000000, 0x000000ff),
 #endif
-    DEF_YUVp(10,  ('P','0','1','0'), NSB, 15, 420),
-    DEF_YUVp(12,  ('P','0','1','2'), NSB, 18, 420),
-    DEF_YUVp(16,  ('P','0','1','6'), NSB, 24, 420),
+    DEF_YUVp(10,  ('I','0','1','0'), NSB, 15, 420),
+    DEF_YUVp(12,  ('I','0','1','2'), NSB, 18, 420),
+    DEF_YUVp(16,  ('I','0','1','6'), NSB, 24, 420),
     DEF_YUVp(10,  ('P','2','1','0'), NSB, 20, 422),
     DEF_YUVp(12,  ('P','2','1','2'), NSB, 24, 422),
     DEF_YUVp(16,  ('P','2','1','6'), NSB, 32, 422),
@@ -143,6 +145,8 @@ static const VideoFormatInfo g_video_formats[] = {
     DEF_YUVp(16,  ('P','4','1','6'), NSB, 48, 444),
     DEF_YUV(I422, ('I','4','2','2'), LSB, 16, 422),
     DEF_YUV(I444, ('I','4','4','4'), LSB, 24, 444),
+    DEF_YUV(P010, ('P','0','1','0'), NSB, 24, 420),
+    DEF_YUV(P016, ('P','0','1','6'), NSB, 24, 420),
     { NULL, }
 };
 
@@ -92,6 +92,12 @@ typedef enum {
     VIDEO_FORMAT_I422,
     /** Planar YUV 4:4:4, 24-bit, 3 planes for Y U V */
     VIDEO_FORMAT_I444,
+    /** Planar YUV 4:2:0, 24-bit, 1 plane for Y and 1 plane for UV,
+        10 bits per sample stored in the most significant bits */
+    VIDEO_FORMAT_P010,
+    /** Planar YUV 4:2:0, 24-bit, 1 plane for Y and 1 plane for UV,
+        16 bits per sample */
+    VIDEO_FORMAT_P016,
     /** Number of video formats */
     VIDEO_FORMAT_COUNT,
 
@@ -112,6 +118,7 @@ typedef struct {
     uint8_t             pixel_offset;   ///< Byte offset within the pixel
     uint8_t             pixel_stride;   ///< Number of bytes for a pixel
     uint8_t             bit_depth;      ///< Number of bits for a sample
+    uint8_t             bit_shift;      ///< Shift count to the sample bits
 } VideoFormatComponentInfo;
 
 typedef struct {